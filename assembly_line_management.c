@@ -7,6 +7,8 @@
 *           piece identification code (4 characters),
 *           time of entry in line (hours:minutes:seconds),
 *           time of exit in line (hours:minutes:seconds). The fields are assumed to be separated by tabs or by space.
+*           An optional sixth field is the number of midnights crossed between entry and exit, without it
+*           an exit time earlier than the entry time is taken as the next day.
 *           For instance:
 *           H235 Sportello_dx N246 15:20:43 15:27:55
 *           K542 Sportello_sx N247 10:03:10 10:15:30
@@ -21,17 +23,178 @@
 *
 *     AUTHOR: Alessandro Serafini <a.serafini21@campus.uniurb.it>
 *
+*     BUILD: gcc -O2 -pthread -o assembly_line_management assembly_line_management.c
+*            add -DENABLE_STATS to count comparisons, visits, allocations and latency of every index operation
+*     USAGE: assembly_line_management [-t threads] [--format columns|csv|tsv] [input_file]
+*            assembly_line_management [-t threads] [--format columns|csv|tsv] --batch command_file [input_file]
+*            assembly_line_management [--snapshot file] ... (loads the snapshot instead of the input file when it exists,
+*                                                           and saves the data set in it on exit)
+*            assembly_line_management [--log file] ...      (records every insertion and removal in the file before
+*                                                           making it, and replays them on startup. With --snapshot
+*                                                           the log is emptied every time the snapshot is saved)
+*            assembly_line_management --bench-time [rows]
+*            assembly_line_management [--format columns|csv|tsv] --bench [max_rows]
+*            assembly_line_management [-t max_readers] [--format columns|csv|tsv] --stress [rows]
+*                                                          (readers querying the trees of a data set while a writer
+*                                                           inserts and removes records, from 1 reader up to
+*                                                           max_readers)
+*
+*     BATCH COMMANDS (one per line, "-" reads them from stdin, times are in seconds, # starts a comment):
+*            insert product_id name piece_id HH:MM:SS HH:MM:SS [days]
+*            remove product_id
+*            find product_id
+*            rank product_id
+*            dump [--sort=id|time]
+*            slowest count
+*            range min_seconds max_seconds
+*            stats
+*            stats ops [--reset]         (counters of the index operations, -DENABLE_STATS builds only)
+*            groups
+*            piece piece_id
+*            apply file                 (insert and remove commands of the file, merged in every index at once)
+*            save file                  (binary snapshot of the data set)
+*
 **********************************************************************************************************************/
 
 
 /* Definition of constants */
-#define INPUT_FILE "input.txt"
+#define INPUT_FILE "input.txt"  /* Default input file, "-" on the command line reads the rows from stdin */
 
 /* Binary tree types */
 #define TYPE_PRODUCT_ID 0
 #define TYPE_PROCESS_TIME 1
 
 #define ID_LENGTH 4
+
+/* Size of the blocks where interned names are stored */
+#define STRING_CHUNK_SIZE 65536
+
+/* Seconds in a day, and most days a process can last */
+#define SECONDS_PER_DAY 86400
+#define MAX_PROCESS_DAYS 999
+
+/* Rows converted by the process time benchmark when not given on the command line */
+#define BENCH_TIME_ROWS 1000000
+
+/* Largest data set of the benchmarks when not given on the command line: they run from 10^3 rows up to it,
+ * multiplying by 10 each time */
+#define BENCH_MAX_ROWS 1000000
+#define BENCH_MIN_ROWS 1000
+
+/* Operations timed together in a sample of the benchmarks, samples of an operation, and samples thrown away first */
+#define BENCH_BATCH 1000
+#define BENCH_SAMPLES 50
+#define BENCH_WARMUP 5
+
+/* Range queries in a sample, and items returned by each of them on average */
+#define BENCH_RANGES 100
+#define BENCH_RANGE_ITEMS 100
+
+/* Longest name accepted in a row of the input file */
+#define MAX_NAME_LENGTH 63
+
+/* First bytes and version of a snapshot file, a snapshot with another version is not loaded */
+#define SNAPSHOT_MAGIC "ALMSNAP"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+
+/* First bytes and version of a log file, and the operations it records */
+#define LOG_MAGIC "ALMLOG"
+#define LOG_VERSION 1
+#define LOG_INSERT 1
+#define LOG_REMOVE 2
+
+/* Group commit: records are written and synced together when a group has this many records, this many bytes,
+ * or when its first record is this old */
+#define LOG_GROUP_RECORDS 512
+#define LOG_GROUP_BYTES (64 * 1024)
+#define LOG_GROUP_NS 10000000LL
+
+/* Size of the log that makes it compacted into the snapshot */
+#define LOG_COMPACT_BYTES (64 * 1024 * 1024)
+
+/* Readers of the shared indexes at most, and objects retired by their writer before it tries to free them */
+#define SHARED_MAX_READERS 64
+#define SHARED_RETIRE_BATCH 1024
+
+/* Kinds of object retired by the writer of the shared indexes */
+#define RETIRED_NODE 0
+#define RETIRED_ARTICLE 1
+#define RETIRED_VERSION 2
+#define RETIRED_POOL 3
+
+/* Rows of the stress test when not given on the command line, seconds of each of its rounds, articles its writer
+ * keeps inserted before removing the oldest one, and items visited by a range scan of its readers */
+#define STRESS_ROWS 1000000
+#define STRESS_SECONDS 1
+#define STRESS_WINDOW 1000
+#define STRESS_SCAN_ITEMS 100
+
+/* Size of the buffer used to read the input file */
+#define READ_BUFFER_SIZE (1 << 20)
+
+/* Smallest input file loaded by more than one thread, and most threads used to load it */
+#define PARALLEL_LOAD_MIN_SIZE (1 << 20)
+#define MAX_LOAD_THREADS 64
+
+/* Most nodes on a path from the root to a leaf. An AVL tree of n nodes is at most 1.44 log2(n) high,
+ * so 64 levels are more than the 2^31 nodes an int can count */
+#define MAX_TREE_HEIGHT 64
+
+/* Articles stored in a chunk of a sorted list (a chunk fills 512 bytes), and articles put in a chunk by build_list(),
+ * the room left lets later insertions avoid splitting the chunk */
+#define LIST_CHUNK_CAPACITY 63
+#define LIST_BUILD_FILL 48
+
+/* Aggregate types, process times are grouped by name or by piece id */
+#define GROUP_BY_NAME 0
+#define GROUP_BY_PIECE_ID 1
+
+/* Sub-buckets per power of 2 of the quantile sketch: values are kept with a relative error of at most 1/32 */
+#define SKETCH_SUB_BUCKETS 32
+#define SKETCH_SUB_BITS 5
+
+/* Index operations with their own counters in ENABLE_STATS builds, the last one collects the work done elsewhere */
+#define STAT_TREE_SEARCH 0
+#define STAT_TREE_INSERT 1
+#define STAT_TREE_REMOVE 2
+#define STAT_LIST_SEARCH 3
+#define STAT_LIST_INSERT 4
+#define STAT_LIST_REMOVE 5
+#define STAT_HASH_SEARCH 6
+#define STAT_HASH_INSERT 7
+#define STAT_HASH_REMOVE 8
+#define STAT_OTHER 9
+#define STAT_OPERATIONS 10
+
+/* Latency buckets of an operation: the sketch buckets of every value up to 2^31 nanoseconds */
+#define STAT_BUCKETS ((32 - SKETCH_SUB_BITS) * SKETCH_SUB_BUCKETS)
+
+/* Instrumentation of the index operations. STAT_BEGIN() starts timing an operation and makes it the one the counters
+ * go to, STAT_END() records its latency before returning. Every thread has its own counters: STAT_FLUSH() adds them
+ * to the ones of the finished threads before the thread returns. Without ENABLE_STATS they compile to nothing */
+#ifdef ENABLE_STATS
+#define STAT_BEGIN(operation) int stat_previous = stat_operation; long long stat_start = now_ns(); stat_operation = (operation)
+#define STAT_END() stat_record(stat_start, stat_previous)
+#define STAT_COUNT(field, amount) (op_stats[stat_operation].field += (amount))
+#define STAT_FLUSH() stat_flush()
+#else
+#define STAT_BEGIN(operation)
+#define STAT_END()
+#define STAT_COUNT(field, amount)
+#define STAT_FLUSH()
+#endif
+
+/* Output formats of the items: aligned columns, comma or tab separated values (with the process time) */
+#define FORMAT_COLUMNS 0
+#define FORMAT_CSV 1
+#define FORMAT_TSV 2
+
+/* Size of the buffer where items are formatted before being written */
+#define OUTPUT_BUFFER_SIZE (1 << 16)
+
+/* Number of objects allocated at once by a memory pool */
+#define POOL_BLOCK_OBJECTS 4096
 #define _GNU_SOURCE
 #define __USE_XOPEN
 
@@ -39,20 +202,120 @@
 /* Including standard libraries */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
 #include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 
 /* Structures declaration */
 
-/* Article structure */
+/* Article structure, a fixed size record of 32 bytes (half a cache line) with no other allocation */
 struct article
 {
-    char  *product_id;
-    char  *name;
-    char  *piece_id;
-    char  *time_entry;
-    char  *time_exit;
-    float process_time;
+    const char *name;         /* Not null terminated: it points in the mapped input file or in the string pool */
+    uint32_t   name_length;
+    uint32_t   product_id;    /* Packed with pack_id(), integer order is the same as string order */
+    uint32_t   piece_id;      /* Packed with pack_id() */
+    uint32_t   time_entry;    /* Seconds since midnight */
+    uint32_t   time_exit;     /* Seconds since midnight */
+    int32_t    process_time;  /* Seconds */
+};
+
+/* Fields of a row of the input file, as parsed by parse_record().
+ * The name is not copied: it points into the buffer holding the row */
+struct record
+{
+    const char *name;
+    size_t     name_length;
+    uint32_t   product_id;
+    uint32_t   piece_id;
+    int        time_entry;
+    int        time_exit;
+    int        process_time;
+};
+
+/* Row skipped by a loading thread, reported once every thread has finished */
+struct load_warning
+{
+    long       line_number; /* Relative to the first row of the chunk */
+    const char *message;
+};
+
+/* Part of the mapped input file loaded by a single thread. The thread creates the articles of its rows
+ * in a single array (so they can be handed over to the articles pool as one block) and sorts them in two runs */
+struct load_chunk
+{
+    const char          *start, *end;      /* Complete rows of the chunk */
+    struct pool_block   *block;            /* Header followed by the articles of the chunk, in file order */
+    int                 count;
+    struct article      **by_product_id;   /* Articles sorted by product id (ties in file order) */
+    struct article      **by_process_time; /* Articles sorted by process time and product id */
+    long                lines;
+    long                first_line;        /* Lines of the file before the chunk */
+    long                *line_numbers;     /* Line of every article, relative to the first row of the chunk */
+    struct load_warning *warnings;
+    int                 warning_count;
+    int                 error;             /* Memory allocation failed */
+};
+
+/* Chunk of the string pool, strings are stored one after another in data */
+struct string_chunk
+{
+    struct string_chunk *next;
+    size_t              used;
+    size_t              size;
+    char                data[];
+};
+
+/* Block of a memory pool, objects are stored one after another after the block header */
+struct pool_block
+{
+    struct pool_block *next;
+};
+
+#ifdef ENABLE_STATS
+/* Counters of an index operation */
+struct op_stats
+{
+    long      calls;
+    long      comparisons;  /* Keys compared */
+    long      visits;       /* Tree nodes, list chunks or hash slots walked through */
+    long      allocations;
+    long long time_ns;
+    long      latency[STAT_BUCKETS];
+};
+#endif
+
+/* Memory pool structure, it hands out objects of a single size carved from big blocks.
+ * Released objects are kept in a free list and recycled by the next allocation */
+struct memory_pool
+{
+    struct pool_block *blocks;
+    void              *free_list;      /* Released objects, each one stores the pointer to the next one */
+    size_t            object_size;
+    size_t            block_used;      /* Objects already carved from the newest block */
+    long              objects;         /* Objects currently allocated */
+    long              block_count;     /* Blocks allocated with malloc() */
+    char              *mapped;         /* Objects of a mapped file, in use but not allocated by the pool */
+    size_t            mapped_length;
+    long              mapped_objects;  /* Objects of the mapped file not released yet */
+};
+
+/* String pool structure, every distinct name is stored once and shared by all the articles with that name */
+struct string_pool
+{
+    struct string_chunk *chunks;
+    const char          **slots; /* Open addressing set of the interned strings, NULL for an empty slot */
+    int                 capacity;
+    int                 count;
 };
 
 /* List element structure */
@@ -63,126 +326,1011 @@ typedef struct list_article
 } list_article_t;
 
 
-/* Node of binary tree structure */
+/* Node of binary tree structure, the tree is kept balanced as an AVL tree */
 struct node
 {
     struct article *item;
     struct node    *left, *right;
+    int            height;
+    int            size;   /* Nodes in the subtree, it gives the rank of a node in O(log n) */
+};
+
+/* In-order cursor over a tree: the path from the root to the current node, so it moves both ways without recursion
+ * and without parent pointers. The cursor is past the end when depth is 0 */
+struct tree_cursor
+{
+    struct node *path[MAX_TREE_HEIGHT];
+    int         depth;
+};
+
+/* Chunk of a sorted list, it holds a sorted run of article pointers one after another */
+struct list_chunk
+{
+    int            count;
+    struct article *items[LIST_CHUNK_CAPACITY];
+};
+
+/* Sorted list structure (unrolled list): a directory of chunks in order. A position is found with a binary search
+ * over the last article of every chunk, then over the chunk, and a display walks the chunks sequentially */
+struct sorted_list
+{
+    struct list_chunk **chunks;
+    int               chunk_count;
+    int               chunk_capacity;
+    int               count;
+    int               type;           /* Sort key, TYPE_PRODUCT_ID or TYPE_PROCESS_TIME */
+};
+
+/* Entry of the product id hash table, it maps a product id to the shared article */
+struct hash_entry
+{
+    struct article *item; /* NULL for an empty slot */
 };
 
-/* Node of list structure */
-struct list_node
+/* Hash table structure (open addressing with linear probing), capacity is always a power of 2 */
+struct hash_table
 {
-    struct article   *item;
-    struct list_node *next;
+    struct hash_entry *entries;
+    int               capacity;
+    int               count;
 };
 
+/* Bucket of a quantile sketch: the number of process times that fall in the bucket with the given index */
+struct sketch_bucket
+{
+    uint16_t index;
+    uint32_t count;
+};
+
+/* Quantile sketch of process times (log-linear histogram). Values below SKETCH_SUB_BUCKETS have a bucket each,
+ * every following power of 2 is split in SKETCH_SUB_BUCKETS buckets. Only the used buckets are stored, in order,
+ * so sketches of small groups stay small, and two sketches are merged by adding their buckets */
+struct quantile_sketch
+{
+    struct sketch_bucket *buckets;
+    int                  count;
+    int                  capacity;
+};
+
+/* Running aggregate of the process times of a group of articles (same name or same piece id) */
+struct aggregate
+{
+    const char             *name;        /* Key of a group by name, NULL for an empty slot */
+    uint32_t               name_length;
+    uint32_t               piece_id;     /* Key of a group by piece id */
+    int                    count;        /* Articles of the group, a group left empty is kept in the table */
+    int64_t                sum;
+    int32_t                min;          /* With min_stale only a lower bound: the last removed minimum */
+    int32_t                max;          /* With max_stale only an upper bound: the last removed maximum */
+    int                    min_stale;
+    int                    max_stale;
+    struct quantile_sketch sketch;
+};
+
+/* Table of aggregates (open addressing with linear probing), capacity is always a power of 2 */
+struct group_table
+{
+    struct aggregate *entries;
+    int              capacity;
+    int              count;
+    int              type;          /* GROUP_BY_NAME or GROUP_BY_PIECE_ID */
+};
+
+/* Output buffer structure: items are formatted in it by hand and handed to stdout in big blocks,
+ * which stdio writes with a single write() call each */
+struct output_buffer
+{
+    char   data[OUTPUT_BUFFER_SIZE];
+    size_t used;
+    int    format;
+};
+
+/* Header of a snapshot file. It is followed by the articles in product id order (struct article, with the offset of
+ * the name in place of its pointer), the positions of the articles in process time order, the position of the article
+ * in every slot of the hash table (uint32_t each, UINT32_MAX for an empty slot) and the names.
+ * Every offset is from the start of the file */
+struct snapshot_header
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order;    /* SNAPSHOT_BYTE_ORDER as written by the machine that saved the file */
+    uint32_t article_size;  /* sizeof(struct article), a different layout makes the snapshot unreadable */
+    uint32_t count;
+    uint64_t articles_offset;
+    uint64_t by_process_time_offset;
+    uint64_t hash_offset;
+    uint64_t hash_capacity;
+    uint64_t names_offset;
+    uint64_t names_length;
+    uint64_t file_length;
+    uint64_t checksum;      /* crc32() of the file after the header */
+};
+
+/* Header of a log file, followed by the records */
+struct log_header
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order;    /* SNAPSHOT_BYTE_ORDER as written by the machine that created the file */
+};
+
+/* Record of a log file, followed by the name of the article (name_length bytes).
+ * A removal only needs the product id, the other fields are 0 */
+struct log_record
+{
+    uint32_t crc;           /* CRC-32 of the rest of the record and of the name */
+    uint32_t operation;     /* LOG_INSERT or LOG_REMOVE */
+    uint32_t product_id;
+    uint32_t piece_id;
+    uint32_t time_entry;
+    uint32_t time_exit;
+    int32_t  process_time;
+    uint32_t name_length;
+};
+
+/* Write-ahead log structure. Records are collected in the buffer and committed a group at a time,
+ * with a single write() and a single fdatasync(). A timer thread commits a group that gets old
+ * while the program waits for its next command; the lock guards the group and the file length */
+struct write_ahead_log
+{
+    int             descriptor;
+    const char      *file;
+    const char      *snapshot_file;  /* Compaction saves the data set here and empties the log, NULL disables it */
+    char            *buffer;
+    size_t          used;
+    size_t          capacity;
+    int             pending;         /* Records in the buffer */
+    long long       first_pending;   /* now_ns() of the first of them */
+    off_t           size;            /* Committed length of the file */
+    off_t           compact_size;    /* Length of the file that starts the next compaction */
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;            /* Signaled when a group starts and when the log is closed */
+    pthread_t       timer;
+    int             timer_started;
+    int             closing;
+};
+
+/* Version of the shared indexes: the roots of both trees, published together. A version never changes,
+ * the writer builds the next one copying the nodes on the paths it changes and sharing all the others */
+struct index_version
+{
+    struct node *root_product_id;
+    struct node *root_process_time;
+    int         count;
+};
+
+/* Reader slot of the shared indexes, alone in its cache line: the epoch the reader entered, 0 while it is out */
+struct reader_slot
+{
+    _Atomic uint64_t epoch;
+    char             padding[64 - sizeof(uint64_t)];
+};
+
+/* Node, article, version or whole pool of nodes unlinked by the writer, it is freed when no reader can reach it anymore */
+struct retired_object
+{
+    void     *object;
+    uint64_t epoch;         /* Epoch of the version that unlinked it */
+    int      kind;          /* RETIRED_NODE, RETIRED_ARTICLE, RETIRED_VERSION or RETIRED_POOL */
+};
+
+/* Shared indexes: one writer at a time changes the trees by path copying and publishes the new version with an
+ * atomic store, readers query the version they loaded without locks and without waiting for the writer.
+ * Unlinked objects are freed with epoch based reclamation */
+struct shared_index
+{
+    struct reader_slot             readers[SHARED_MAX_READERS];
+    _Atomic(struct index_version *) version;
+    _Atomic uint64_t               epoch;
+    pthread_mutex_t                writer;
+    struct memory_pool             nodes;
+    struct memory_pool             versions;
+    struct memory_pool             *articles;  /* Removed articles are given back to this pool, if any */
+    struct retired_object          *retired;
+    int                            retired_count;
+    int                            retired_capacity;
+    struct node                    *fresh[3 * MAX_TREE_HEIGHT + 1];  /* Nodes made by the current tree change */
+    int                            fresh_count;
+};
+
+/* Data set structure, it groups every index built over the same shared articles.
+ * The trees are shared indexes: the main thread is their only writer and reads the roots of the current version
+ * from the data set, other threads read them through reader_enter() without blocking it */
+struct data_set
+{
+    struct node            *root_product_id;
+    struct node            *root_process_time;
+    struct shared_index    trees;
+    struct sorted_list     list_product_id;
+    struct sorted_list     list_process_time;
+    struct hash_table      ids;
+    struct group_table     by_name;        /* Aggregates updated on every insertion and removal */
+    struct group_table     by_piece_id;
+    struct string_pool     names;
+    struct memory_pool     articles;
+    struct memory_pool     list_chunks;
+    void                   *mapped_file;   /* Input file mapped in memory, names of the loaded articles point in it */
+    size_t                 mapped_length;
+    struct article         **pending;      /* Articles loaded in an empty data set, indexed all at once at the end */
+    int                    pending_count;
+    int                    pending_capacity;
+    int                    count;
+    long                   changes;        /* Insertions and removals since the data set was loaded or saved */
+    struct write_ahead_log *log;           /* Inserts and removals are recorded here first, NULL without a log */
+};
+
+/* Thread of the stress test, the writer or one of the readers */
+struct stress_thread
+{
+    struct data_set     *data;
+    struct article      **stable;       /* Loaded articles, never removed: every lookup of them must succeed */
+    int                 stable_count;
+    int                 reader;         /* Reader slot, -1 for the writer */
+    uint64_t            seed;
+    atomic_int          *stop;
+    long                operations;
+    long                errors;         /* Failed lookups and range scans out of order */
+};
+
+/* Items printed by every function of the program go through this buffer */
+static struct output_buffer output;
+
+#ifdef ENABLE_STATS
+/* Counters of every index operation and the operation running now, for each thread */
+static _Thread_local struct op_stats op_stats[STAT_OPERATIONS];
+static _Thread_local int             stat_operation = STAT_OTHER;
+
+/* Counters of the threads that returned, added by stat_flush() */
+static struct op_stats flushed_stats[STAT_OPERATIONS];
+static pthread_mutex_t flushed_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* The benchmarks add their results here, so the compiler can't drop the loops computing them */
+static volatile long bench_sink;
+
 /* Declaration of functions */
 
 /* Article functions */
-struct article *new_article(char *product_id,
-                            char *name,
-                            char *piece_id,
-                            char *time_entry,
-                            char *time_exit,
-                            float process_time);
+struct article *new_article(struct memory_pool *pool,
+                            struct string_pool *names,
+                            uint32_t product_id,
+                            const char *name,
+                            size_t name_length,
+                            uint32_t piece_id,
+                            uint32_t time_entry,
+                            uint32_t time_exit,
+                            int32_t process_time);
 
 void print_article(struct article *item);
 
-/* Binary tree functions */
-struct node *load_data(const char file[],
+int parse_format(const char *format);
+
+uint32_t pack_id(const char *id);
+
+void unpack_id(uint32_t key,
+               char *id);
+
+/* Loading functions */
+int init_data_set(struct data_set *data);
+
+int load_data(const char file[],
+              int threads,
+              struct data_set *data);
+
+int load_stream(FILE *f,
+                struct data_set *data);
+
+int load_mapped(const char *map,
+                size_t length,
+                struct data_set *data);
+
+int load_parallel(const char *map,
+                  size_t length,
+                  int threads,
+                  struct data_set *data);
+
+void *load_chunk_thread(void *argument);
+
+long chunk_line(struct load_chunk *chunks,
+                int chunk_count,
+                struct article *item);
+
+int merge_runs(struct article ***runs,
+               int *counts,
+               int run_count,
+               struct article **merged,
+               int type);
+
+int bulk_load(struct data_set *data,
+              struct article **by_product_id,
+              struct article **by_process_time,
+              int count);
+
+int index_pending(struct data_set *data);
+
+const char *parse_record(const char *line,
+                         const char *end,
+                         struct record *record);
+
+int load_buffer(struct data_set *data,
+                const char *buffer,
+                const char *end,
+                int zero_copy,
+                long *line_number,
+                const char **next_line);
+
+int insert_article(struct data_set *data,
+                   struct article *item);
+
+void remove_article(struct data_set *data,
+                    struct article *item);
+
+void update_roots(struct data_set *data);
+
+void free_data_set(struct data_set *data);
+
+void print_memory_report(struct data_set *data);
+
+
+/* Snapshot functions */
+int save_snapshot(struct data_set *data,
+                  const char *file);
+
+int load_snapshot(const char *file,
+                  struct data_set *data);
+
+static int snapshot_write(FILE *f,
+                          const void *bytes,
+                          size_t size,
+                          size_t count,
+                          uint32_t *crc);
+
+static int snapshot_positions(uint64_t *pairs,
+                              uint32_t count,
+                              uint32_t *positions);
+
+
+/* Log functions */
+long log_open(struct write_ahead_log *log,
+              const char *file,
+              const char *snapshot_file,
+              struct data_set *data);
+
+int log_append(struct data_set *data,
+               int operation,
+               struct article *item,
+               int sync);
+
+int log_commit(struct data_set *data);
+
+void *log_timer(void *argument);
+
+int log_checkpoint(struct data_set *data);
+
+int log_compact(struct data_set *data);
+
+void log_close(struct write_ahead_log *log);
+
+uint32_t crc32(uint32_t crc,
+               const void *bytes,
+               size_t length);
+
+
+/* Shared index functions */
+int shared_init(struct shared_index *index,
+                struct memory_pool *articles);
+
+int shared_build(struct shared_index *index,
+                 struct article **by_product_id,
+                 struct article **by_process_time,
+                 int count,
+                 struct article **removed,
+                 int removed_count);
+
+struct index_version *reader_enter(struct shared_index *index,
+                                   int reader);
+
+void reader_exit(struct shared_index *index,
+                 int reader);
+
+int shared_insert(struct shared_index *index,
+                  struct article *item);
+
+int shared_remove(struct shared_index *index,
+                  uint32_t product_id);
+
+void shared_reclaim(struct shared_index *index);
+
+void shared_free(struct shared_index *index);
+
+static int shared_publish(struct shared_index *index,
+                          struct index_version *old,
+                          struct index_version *version,
+                          int first_retired,
+                          int result);
+
+static int retire(struct shared_index *index,
+                  void *object,
+                  int kind);
+
+static struct node *copy_node(struct shared_index *index,
+                              struct node *node);
+
+static struct node *copy_balance(struct shared_index *index,
+                                 struct node *node);
+
+static int copy_insert(struct shared_index *index,
+                       struct node **root,
+                       struct article *item,
+                       int type);
+
+static int copy_remove(struct shared_index *index,
+                       struct node **root,
+                       struct article *item,
                        int type);
 
-struct node *new_node(struct article *item);
 
-struct node *insert(struct node *node,
-                    struct article *item,
-                    int type);
+/* Binary tree functions */
+
+struct node *new_node(struct memory_pool *pool,
+                      struct article *item);
+
+int compare_items(struct article *a,
+                  struct article *b,
+                  int type);
+
+int node_height(struct node *node);
+
+void update_height(struct node *node);
 
-struct node *min_value_node(struct node *node);
+struct node *rotate_left(struct node *node);
 
-struct node *remove_product(struct node *root,
-                            struct article *item,
-                            int type);
+struct node *rotate_right(struct node *node);
+
+struct node *balance(struct node *node);
 
 struct node *search_id(struct node *root,
-                       char *product_id);
+                       uint32_t product_id);
+
+struct node *build_tree(struct memory_pool *pool,
+                        struct article **items,
+                        int count);
+
+int sort_articles(struct article **items,
+                  int count,
+                  int type);
 
 void print_tree(struct node *root);
 
+int node_size(struct node *node);
+
+struct node *select_node(struct node *root,
+                         int rank);
+
+int rank_of(struct node *root,
+            struct article *item,
+            int type);
+
+long nearest_rank(double fraction,
+                  long count);
+
+struct article *percentile(struct node *root,
+                           double fraction);
+
+int print_range(struct node *root,
+                int32_t low,
+                int32_t high);
+
+void print_slowest(struct node *root,
+                   int *remaining);
+
+void cursor_first(struct tree_cursor *cursor,
+                  struct node *root);
+
+void cursor_last(struct tree_cursor *cursor,
+                 struct node *root);
+
+void cursor_seek(struct tree_cursor *cursor,
+                 struct node *root,
+                 struct article *key,
+                 int type);
+
+struct article *cursor_item(struct tree_cursor *cursor);
+
+void cursor_next(struct tree_cursor *cursor);
+
+void cursor_prev(struct tree_cursor *cursor);
+
 
 /* List functions */
-struct list_node *insert_in_list(struct list_node *head_ref,
-                                 struct list_node *new_list_node,
-                                 int type);
+void list_init(struct sorted_list *list,
+               int type);
+
+int insert_in_list(struct memory_pool *pool,
+                   struct sorted_list *list,
+                   struct article *item);
+
+void print_list(struct sorted_list *list);
+
+int remove_list_item(struct memory_pool *pool,
+                     struct sorted_list *list,
+                     struct article *item);
+
+struct article *search_in_list(struct sorted_list *list,
+                               uint32_t product_id);
+
+int build_list(struct memory_pool *pool,
+               struct sorted_list *list,
+               struct article **items,
+               int count);
+
+void list_free(struct sorted_list *list);
+
+int list_to_array(struct sorted_list *list,
+                  struct article **items);
+
 
-struct list_node *create_list_node(struct article *item);
+/* Hash table functions */
+unsigned int hash_id(uint32_t product_id);
 
-void print_list(struct list_node *head);
+int hash_init(struct hash_table *table,
+              int capacity);
 
-struct list_node *load_data_list(const char file[],
-                                 int type);
+struct hash_entry *hash_search(struct hash_table *table,
+                               uint32_t product_id);
 
-void remove_list_item(struct list_node *head,
-                      struct list_node *node_to_remove);
+int hash_insert(struct hash_table *table,
+                struct article *item);
 
-struct list_node *search_in_list(struct list_node *head,
-                                 char *product_id);
+void hash_remove(struct hash_table *table,
+                 struct hash_entry *entry);
+
+int hash_resize(struct hash_table *table,
+                int capacity);
+
+void hash_free(struct hash_table *table);
+
+
+/* Aggregate functions */
+int group_init(struct group_table *table,
+               int capacity,
+               int type);
+
+struct aggregate *group_find(struct group_table *table,
+                             struct article *item,
+                             int create);
+
+int aggregate_add(struct data_set *data,
+                  struct article *item);
+
+void aggregate_remove(struct data_set *data,
+                      struct article *item);
+
+int32_t aggregate_quantile(struct aggregate *group,
+                           double fraction);
+
+void print_aggregate(const char *label,
+                     int label_length,
+                     struct aggregate *group);
+
+void group_resolve(struct group_table *table,
+                   struct aggregate *group,
+                   struct node *root_process_time);
+
+void print_groups(struct group_table *table,
+                  struct node *root_process_time);
+
+void group_free(struct group_table *table);
+
+int sketch_index(int32_t value);
+
+int32_t sketch_value(int index);
+
+void sketch_bounds(int index,
+                   int32_t *low,
+                   int32_t *high);
+
+int sketch_add(struct quantile_sketch *sketch,
+               int32_t value,
+               int delta);
+
+int sketch_merge(struct quantile_sketch *into,
+                 struct quantile_sketch *from);
+
+int32_t sketch_quantile(struct quantile_sketch *sketch,
+                        double fraction);
+
+
+/* Memory pool functions */
+void pool_init(struct memory_pool *pool,
+               size_t object_size);
+
+void *pool_alloc(struct memory_pool *pool);
+
+void pool_release(struct memory_pool *pool,
+                  void *object);
+
+void pool_destroy(struct memory_pool *pool);
+
+void pool_adopt(struct memory_pool *pool,
+                struct pool_block *block,
+                long objects);
+
+void pool_map(struct memory_pool *pool,
+              void *objects,
+              long count);
+
+
+/* String pool functions */
+int string_pool_init(struct string_pool *pool,
+                     int capacity);
+
+const char *intern_string(struct string_pool *pool,
+                          const char *string,
+                          size_t length);
+
+void string_pool_free(struct string_pool *pool);
+
+static unsigned int hash_string(const char *string,
+                                size_t length);
 
 
 /* Time functions */
-void get_valid_time(char *when,
-                    char *bigger_then);
+int get_valid_time(char *when);
 
 double get_prod_process_time(char *time_entry,
                              char *time_exit);
 
+int get_process_time(int time_entry,
+                     int time_exit,
+                     int days);
+
+void bench_process_time(long rows);
+
+int parse_time(const char *time,
+               size_t length);
+
+int time_to_seconds(const char *time);
+
+void format_time(uint32_t seconds,
+                 char *time);
+
+/* Output functions */
+char *output_reserve(size_t length);
+
+void output_flush();
+
+char *format_number(int32_t value,
+                    char *out);
+
+
 /* General functions */
 void print_data(struct node *root);
 
+void print_header();
+
+void print_footer();
+
 void clear_buffer();
 
 int get_valid_int(char *field_name);
 
 
-/* Main function */
-int main()
-{
-    printf("\n*************************\nAssembly line management\n*************************\n");
-    
-    /* Initialization of 2 binary trees, one for each type of data (product id and processing time) */
-    struct node *root_product_id   = load_data(INPUT_FILE,
-                                               TYPE_PRODUCT_ID);
-    struct node *root_process_time = load_data(INPUT_FILE,
-                                               TYPE_PROCESS_TIME);
-    
-    /* Initialization of 2 lists, one for each type of data (product id and processing time) */
-    struct list_node *head_product_id   = load_data_list(INPUT_FILE,
-                                                         TYPE_PRODUCT_ID);
-    struct list_node *head_process_time = load_data_list(INPUT_FILE,
-                                                         TYPE_PROCESS_TIME);
-    
-    
-    /* Check for errors during the loading of data */
-    if (root_product_id == NULL || root_process_time == NULL)
-    {
-        printf("Opening file error\n");
-    }
-    else
-    {
-        int choice;
-        
-        /* Menu options */
-        do
-        {
-            printf("\n");
-            printf("Choose an option:\n");
-            printf("1) Display items\n");
-            printf("2) Insert item\n");
-            printf("3) Remove item\n");
-            printf("0) Exit\n\n");
-            printf("Choice: ");
-            choice = get_valid_int("Choice"); /* Acquiring a valid integer using get_valid_int() function */
+/* Statistics functions */
+#ifdef ENABLE_STATS
+void stat_record(long long start,
+                 int previous);
+
+void stat_flush();
+
+void print_op_stats();
+
+void reset_op_stats();
+#endif
+
+
+/* Benchmark functions */
+void run_benchmarks(long max_rows);
+
+int bench_tree(struct article **items,
+               int count,
+               int type);
+
+int bench_shared(struct article **items,
+                 int count,
+                 struct article **extra);
+
+int bench_list(struct article **items,
+               int count,
+               struct article **extra,
+               int type);
+
+int bench_hash(struct article **items,
+               int count,
+               struct article **extra);
+
+long long now_ns();
+
+int compare_samples(const void *a,
+                    const void *b);
+
+void print_bench(const char *engine,
+                 const char *operation,
+                 int rows,
+                 double *samples,
+                 int count);
+
+
+/* Stress test functions */
+void run_stress(long rows,
+                int max_readers);
+
+int stress_round(struct data_set *data,
+                 struct article **stable,
+                 int stable_count,
+                 int readers,
+                 double *reads_per_second,
+                 double *writes_per_second,
+                 long *errors);
+
+void *stress_reader(void *argument);
+
+void *stress_writer(void *argument);
+
+int check_shared(struct shared_index *index);
+
+
+/* Batch functions */
+long run_batch(const char *file,
+               struct data_set *data);
+
+const char *run_command(struct data_set *data,
+                        char *line,
+                        size_t length);
+
+void print_statistics(struct node *root);
+
+long apply_batch(struct data_set *data,
+                 const char *file);
+
+int merge_sorted(struct article **old,
+                 int old_count,
+                 struct article **removed,
+                 int removed_count,
+                 struct article **added,
+                 int added_count,
+                 struct article **merged,
+                 int type);
+
+
+/* Main function, the optional arguments are the number of loading threads and the input file ("-" for stdin) */
+int main(int argc,
+         char *argv[])
+{
+    const char *input_file = INPUT_FILE;
+    const char *batch_file    = NULL;
+    const char *snapshot_file = NULL;
+    const char *log_file      = NULL;
+    long       bench_rows     = 0;
+    long       stress_rows    = 0;
+    long       replayed       = 0;
+    int        threads     = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int        i;
+    
+    for (i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i],
+                    "-t") == 0 || strcmp(argv[i],
+                                         "--threads") == 0) && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i],
+                        "--bench-time") == 0)
+        {
+            bench_process_time(i + 1 < argc ? atol(argv[i + 1]) : BENCH_TIME_ROWS);
+            return 0;
+        }
+        else if (strcmp(argv[i],
+                        "--bench") == 0)
+        {
+            bench_rows = BENCH_MAX_ROWS;
+            if (i + 1 < argc && atol(argv[i + 1]) > 0)
+            {
+                bench_rows = atol(argv[++i]);
+            }
+        }
+        else if (strcmp(argv[i],
+                        "--stress") == 0)
+        {
+            stress_rows = STRESS_ROWS;
+            if (i + 1 < argc && atol(argv[i + 1]) > 0)
+            {
+                stress_rows = atol(argv[++i]);
+            }
+        }
+        else if (strcmp(argv[i],
+                        "--snapshot") == 0 && i + 1 < argc)
+        {
+            snapshot_file = argv[++i];
+        }
+        else if (strcmp(argv[i],
+                        "--log") == 0 && i + 1 < argc)
+        {
+            log_file = argv[++i];
+        }
+        else if (strcmp(argv[i],
+                        "--batch") == 0 && i + 1 < argc)
+        {
+            batch_file = argv[++i];
+        }
+        else if (strcmp(argv[i],
+                        "--format") == 0 && i + 1 < argc)
+        {
+            output.format = parse_format(argv[++i]);
+            if (output.format < 0)
+            {
+                printf("Format must be columns, csv or tsv\n");
+                return 1;
+            }
+        }
+        else
+        {
+            input_file = argv[i];
+        }
+    }
+    
+    /* The log is compacted in the snapshot, without it the log would only grow */
+    if (log_file != NULL && snapshot_file == NULL)
+    {
+        printf("The log needs a snapshot file, use --snapshot with --log\n");
+        return 1;
+    }
+    
+    if (bench_rows > 0)
+    {
+        run_benchmarks(bench_rows);
+        return 0;
+    }
+    if (stress_rows > 0)
+    {
+        run_stress(stress_rows,
+                   threads);
+        return 0;
+    }
+    
+    if (batch_file == NULL)
+    {
+        printf("\n*************************\nAssembly line management\n*************************\n");
+    }
+    
+    /* Initialization of 2 binary trees and 2 lists, one for each type of data (product id and processing time).
+     * The input file is read only once and every index shares the same articles */
+    struct data_set        data;
+    struct write_ahead_log log;
+    int                    loaded        = -1;
+    int                    from_snapshot = 0;
+    
+    /* Elaboration time for data loading */
+    clock_t start_load = clock();
+    if (init_data_set(&data) == 0)
+    {
+        /* A saved snapshot replaces the input file, without it the input file is loaded as usual.
+         * A file that is not a valid snapshot is left alone, and it is not overwritten on exit.
+         * With a log it stops the program instead: the log only holds the changes made after that snapshot */
+        if (snapshot_file != NULL)
+        {
+            loaded = load_snapshot(snapshot_file,
+                                   &data);
+            if (loaded == -1 && log_file != NULL)
+            {
+                fprintf(stderr,
+                        "[WARNING] %s: the log can't be replayed without its snapshot\n",
+                        log_file);
+            }
+            else if (loaded == -1)
+            {
+                snapshot_file = NULL;
+            }
+            from_snapshot = loaded >= 0;
+        }
+        if (loaded == -2 || (loaded == -1 && snapshot_file == NULL))
+        {
+            loaded = load_data(input_file,
+                               threads,
+                               &data);
+        }
+        
+        /* The log makes again the changes made after the data set was saved, a log that can't be replayed
+         * stops the program before anything is saved */
+        if (loaded >= 0 && log_file != NULL)
+        {
+            replayed = log_open(&log,
+                                log_file,
+                                snapshot_file,
+                                &data);
+            if (replayed < 0)
+            {
+                loaded = -1;
+            }
+        }
+    }
+    clock_t end_load = clock();
+    
+    /* Check for errors during the loading of data, the batch mode may start from an empty data set */
+    if (loaded < 0 || (batch_file == NULL && (data.root_product_id == NULL || data.root_process_time == NULL)))
+    {
+        printf("Opening file error\n");
+    }
+    else if (batch_file != NULL)
+    {
+        /* Batch mode: no menu, the output of the commands is the only thing written on stdout */
+        fprintf(stderr,
+                "%d records loaded in %f milliseconds\n",
+                loaded,
+                (double) (end_load - start_load) / CLOCKS_PER_SEC * 1000);
+        if (data.log != NULL)
+        {
+            fprintf(stderr,
+                    "%ld log records replayed, %d records\n",
+                    replayed,
+                    data.count);
+        }
+        
+        clock_t start_batch = clock();
+        long    commands    = run_batch(batch_file,
+                                        &data);
+        clock_t end_batch   = clock();
+        
+        if (commands < 0)
+        {
+            fprintf(stderr,
+                    "Opening command file error\n");
+        }
+        else
+        {
+            double time_spent_batch = (double) (end_batch - start_batch) / CLOCKS_PER_SEC;
+            fprintf(stderr,
+                    "%ld commands in %f milliseconds (%.0f commands per second), %d records\n",
+                    commands,
+                    time_spent_batch * 1000,
+                    time_spent_batch > 0 ? commands / time_spent_batch : 0,
+                    data.count);
+        }
+    }
+    else
+    {
+        double time_spent_load = (double) (end_load - start_load) / CLOCKS_PER_SEC;
+        printf("\n%d records loaded\nTime taken for data loading: %f milliseconds\n",
+               loaded,
+               time_spent_load * 1000);
+        if (data.log != NULL)
+        {
+            printf("%ld log records replayed, %d records\n",
+                   replayed,
+                   data.count);
+        }
+        print_memory_report(&data);
+        
+        int choice;
+        
+        /* Menu options */
+        do
+        {
+            printf("\n");
+            printf("Choose an option:\n");
+            printf("1) Display items\n");
+            printf("2) Insert item\n");
+            printf("3) Remove item\n");
+            printf("4) Display slowest items\n");
+            printf("5) Display items by processing time range\n");
+            printf("6) Processing time statistics\n");
+            printf("7) Processing time rank of an item\n");
+            printf("8) Processing time statistics by name\n");
+            printf("9) Processing time statistics of a piece id\n");
+            printf("0) Exit\n\n");
+            printf("Choice: ");
+            choice = get_valid_int("Choice"); /* Acquiring a valid integer using get_valid_int() function */
             printf("\n");
             
             switch (choice)
@@ -191,7 +1339,7 @@ int main()
                 case 1:
                     /* Before displaying data, user must select a sort key,
                      * but if the binary tree is empty, this step can be skipped */
-                    if (root_product_id == NULL)
+                    if (data.root_product_id == NULL)
                     {
                         printf("--------------------------------------------------------------\n");
                         printf("Data set is empty\n");
@@ -227,12 +1375,12 @@ int main()
                         {
                             case TYPE_PRODUCT_ID:
                                 printf("Product id");
-                                print_data(root_product_id);
+                                print_data(data.root_product_id);
                                 break;
                             
                             case TYPE_PROCESS_TIME:
                                 printf("Processing time");
-                                print_data(root_process_time);
+                                print_data(data.root_process_time);
                                 break;
                             
                             default:
@@ -254,12 +1402,12 @@ int main()
                         {
                             case TYPE_PRODUCT_ID:
                                 printf("Product id\n");
-                                print_list(head_product_id);
+                                print_list(&data.list_product_id);
                                 break;
                             
                             case TYPE_PROCESS_TIME:
                                 printf("Processing time\n");
-                                print_list(head_process_time);
+                                print_list(&data.list_process_time);
                                 break;
                             
                             default:
@@ -291,18 +1439,18 @@ int main()
                     {
                         scanf("%s",
                               product_id);
-                        if (search_id(root_product_id,
-                                      product_id) != NULL)
+                        if (strlen(product_id) > ID_LENGTH || strlen(product_id) < ID_LENGTH)
                         {
                             clear_buffer();
-                            printf("A record with product id: %s already exists, try again: ",
-                                   product_id);
+                            printf("Product id length must be of %d characters: ",
+                                   ID_LENGTH);
                         }
-                        else if (strlen(product_id) > ID_LENGTH || strlen(product_id) < ID_LENGTH)
+                        else if (hash_search(&data.ids,
+                                             pack_id(product_id)) != NULL)
                         {
                             clear_buffer();
-                            printf("Product id length must be of %d characters: ",
-                                   ID_LENGTH);
+                            printf("A record with product id: %s already exists, try again: ",
+                                   product_id);
                         }
                         else
                         {
@@ -339,72 +1487,65 @@ int main()
                     
                     
                     /* Acquision of the time entry and time exit values. Both values ​​must have a specific format,
-                     * for this reason I verify the formats through the function get_valid_time */
+                     * for this reason I verify the formats through the function get_valid_time.
+                     * An exit time earlier than the entry time means that the process crossed midnight */
                     printf("Time entry (HH:MM:SS format): ");
-                    get_valid_time(time_entry,
-                                   time_entry);
+                    int seconds_entry = get_valid_time(time_entry);
                     
                     printf("Time exit (HH:MM:SS format): ");
-                    get_valid_time(time_exit,
-                                   time_entry);
+                    int seconds_exit = get_valid_time(time_exit);
+                    if (seconds_exit < seconds_entry)
+                    {
+                        printf("Exit time is earlier than entry time, the process ends the next day\n");
+                    }
                     
                     /* Creating new article and inserting it every binary tree */
-                    struct article *item = new_article(product_id,
+                    struct article *item = new_article(&data.articles,
+                                                       &data.names,
+                                                       pack_id(product_id),
                                                        name,
-                                                       piece_id,
-                                                       time_entry,
-                                                       time_exit,
-                                                       get_prod_process_time(time_entry,
-                                                                             time_exit));
+                                                       strlen(name),
+                                                       pack_id(piece_id),
+                                                       seconds_entry,
+                                                       seconds_exit,
+                                                       get_process_time(seconds_entry,
+                                                                        seconds_exit,
+                                                                        -1));
                     
                     
-                    if (item != NULL)
+                    /* The insertion is recorded in the log, and committed, before it is made */
+                    if (item != NULL && log_append(&data,
+                                                   LOG_INSERT,
+                                                   item,
+                                                   1) != 0)
+                    {
+                        pool_release(&data.articles,
+                                     item);
+                        printf("\nThe log can't be written, record not inserted\n");
+                    }
+                    else if (item != NULL)
                     {
-                        /* Elaboration time for tree insert */
+                        /* Inserting the article in both binary trees, both lists, the hash table and the aggregates.
+                         * Elaboration time for every index */
                         clock_t start_insert = clock();
+                        int     inserted     = insert_article(&data,
+                                                              item);
+                        clock_t end_insert   = clock();
                         
-                        root_product_id   = insert(root_product_id,
-                                                   item,
-                                                   TYPE_PRODUCT_ID);
-                        root_process_time = insert(root_process_time,
-                                                   item,
-                                                   TYPE_PROCESS_TIME);
-                        
-                        clock_t end_insert        = clock();
-                        double  time_spent_insert = (double) (end_insert - start_insert) / CLOCKS_PER_SEC;
-                        
-                        printf("\n\nTime taken for binary tree: %f milliseconds",
-                               time_spent_insert * 1000);
-                        
-                        /* Inserting article every list */
-                        
-                        /* Start with the empty list */
-                        struct list_node *new_list_node = NULL;
-                        
-                        /* Elaboration time for list insert */
-                        start_insert = clock();
-                        
-                        new_list_node   = create_list_node(item);
-                        head_product_id = insert_in_list(head_product_id,
-                                                         new_list_node,
-                                                         TYPE_PRODUCT_ID);
-                        
-                        new_list_node     = create_list_node(item);
-                        head_process_time = insert_in_list(head_process_time,
-                                                           new_list_node,
-                                                           TYPE_PROCESS_TIME);
-                        
-                        printf("\n\nUpdated Linked List:\n");
-                        print_list(head_product_id);
-                        
-                        end_insert        = clock();
-                        time_spent_insert = (double) (end_insert - start_insert) / CLOCKS_PER_SEC;
+                        if (inserted != 0)
+                        {
+                            choice = 0; /* Memory allocation error, exit the program setting the choice = 0 */
+                            break;
+                        }
                         
-                        printf("\n\nTime taken for list: %f milliseconds\n\n",
-                               time_spent_insert * 1000);
+                        printf("\n\nUpdated List:\n");
+                        print_list(&data.list_product_id);
                         
+                        printf("\n\nTime taken for every index: %f milliseconds\n\n",
+                               (double) (end_insert - start_insert) / CLOCKS_PER_SEC * 1000);
                         
                         printf("\nRecord inserted successfully\n\n");
+                        log_checkpoint(&data);
                         
                     }
                     else
@@ -416,77 +1557,202 @@ int main()
                 
                 case 3:
                     printf("Remove item");
-                    print_data(root_product_id); /* Displaying data to ease the user to select the product id */
+                    print_data(data.root_product_id); /* Displaying data to ease the user to select the product id */
                     
-                    /* Checking if the selected product id exists */
-                    char id_to_remove[64];
+                    /* Checking if the selected product id exists in the hash table, the found entry
+                     * holds the article and its list nodes, so no index has to be searched again */
+                    char              id_to_remove[64];
+                    struct hash_entry *entry_to_remove = NULL;
                     printf("\nProduct id to remove: ");
-                    int id_not_exists = 1;
-                    while (id_not_exists)
+                    while (entry_to_remove == NULL)
                     {
                         scanf("%s",
                               id_to_remove);
-                        if (search_id(root_product_id,
-                                      id_to_remove) == NULL)
+                        if (strlen(id_to_remove) == ID_LENGTH)
                         {
-                            clear_buffer();
-                            printf("Product id does not exist, try again: ");
+                            entry_to_remove = hash_search(&data.ids,
+                                                          pack_id(id_to_remove));
                         }
-                        else
+                        if (entry_to_remove == NULL)
                         {
-                            id_not_exists = 0;
+                            clear_buffer();
+                            printf("Product id does not exist, try again: ");
                         }
                     }
                     
-                    /* Searching the node to remove by the selected product id and deleting that node from every binary tree */
+                    /* The removal is recorded in the log, and committed, before it is made */
+                    if (log_append(&data,
+                                   LOG_REMOVE,
+                                   entry_to_remove->item,
+                                   1) != 0)
+                    {
+                        printf("\nThe log can't be written, record not removed\n");
+                        break;
+                    }
                     
-                    /* Elaboration time for tree remove */
+                    /* Deleting the article from both binary trees, both lists, the hash table and the aggregates.
+                     * Elaboration time for every index */
                     clock_t start_remove = clock();
+                    remove_article(&data,
+                                   entry_to_remove->item);
+                    clock_t end_remove = clock();
+                    
+                    printf("\n\nTime taken for every index: %f milliseconds\n\n",
+                           (double) (end_remove - start_remove) / CLOCKS_PER_SEC * 1000);
+                    
+                    printf("\n\nRecord removed successfully\n");
+                    log_checkpoint(&data);
                     
-                    struct node *node_to_remove = search_id(root_product_id,
-                                                            id_to_remove);
-                    root_product_id = remove_product(root_product_id,
-                                                     node_to_remove->item,
-                                                     TYPE_PRODUCT_ID);
                     
-                    node_to_remove    = search_id(root_process_time,
-                                                  id_to_remove);
-                    root_process_time = remove_product(root_process_time,
-                                                       node_to_remove->item,
-                                                       TYPE_PROCESS_TIME);
+                    break;
+                
+                case 4:
+                    /* The slowest items are the last ones of the process time tree, visited backwards */
+                    printf("Display slowest items\n");
+                    printf("Number of items: ");
+                    int remaining = get_valid_int("Number of items");
                     
+                    clock_t start_query = clock();
+                    print_header();
+                    print_slowest(data.root_process_time,
+                                  &remaining);
+                    print_footer();
+                    clock_t end_query = clock();
                     
-                    clock_t end_remove        = clock();
-                    double  time_spent_remove = (double) (end_remove - start_remove) / CLOCKS_PER_SEC;
-                    printf("\n\nTime taken for binary tree: %f milliseconds",
-                           time_spent_remove * 1000);
+                    printf("\nTime taken for binary tree: %f milliseconds\n\n",
+                           (double) (end_query - start_query) / CLOCKS_PER_SEC * 1000);
+                    break;
+                
+                case 5:
+                    /* Only the subtrees that overlap the range are visited */
+                    printf("Display items by processing time range\n");
+                    printf("Minimum processing time (minutes): ");
+                    int low = get_valid_int("Minimum processing time");
+                    printf("Maximum processing time (minutes): ");
+                    int high = get_valid_int("Maximum processing time");
                     
+                    start_query = clock();
+                    print_header();
+                    int found = print_range(data.root_process_time,
+                                            low * 60,
+                                            high * 60);
+                    print_footer();
+                    end_query = clock();
                     
-                    /* Searching the node to remove by the selected product id and deleting that node from every list */
+                    printf("%d items between %d and %d minutes\n",
+                           found,
+                           low,
+                           high);
+                    printf("\nTime taken for binary tree: %f milliseconds\n\n",
+                           (double) (end_query - start_query) / CLOCKS_PER_SEC * 1000);
+                    break;
+                
+                case 6:
+                    /* Percentiles are found by rank with the subtree sizes, nearest-rank method */
+                    if (data.root_process_time == NULL)
+                    {
+                        printf("Data set is empty\n");
+                        break;
+                    }
                     
-                    /* Elaboration time for list remove */
-                    start_remove = clock();
+                    start_query = clock();
+                    printf("Processing time statistics (seconds)\n");
+                    print_statistics(data.root_process_time);
+                    end_query = clock();
                     
-                    struct list_node *list_node_to_remove = search_in_list(head_product_id,
-                                                                           id_to_remove);
-                    remove_list_item(head_product_id,
-                                     list_node_to_remove);
+                    printf("\nTime taken for binary tree: %f milliseconds\n\n",
+                           (double) (end_query - start_query) / CLOCKS_PER_SEC * 1000);
+                    break;
+                
+                case 7:
+                    /* The article is found by product id in the hash table, then ranked in the process time tree */
+                    printf("Processing time rank of an item\n");
+                    printf("Product id: ");
+                    char              id_to_rank[64];
+                    struct hash_entry *entry_to_rank = NULL;
+                    if (scanf("%63s",
+                              id_to_rank) == 1 && strlen(id_to_rank) == ID_LENGTH)
+                    {
+                        entry_to_rank = hash_search(&data.ids,
+                                                    pack_id(id_to_rank));
+                    }
+                    clear_buffer();
                     
-                    list_node_to_remove = search_in_list(head_process_time,
-                                                         id_to_remove);
-                    remove_list_item(head_process_time,
-                                     list_node_to_remove);
+                    if (entry_to_rank == NULL)
+                    {
+                        printf("Product id does not exist\n");
+                        break;
+                    }
                     
+                    start_query = clock();
+                    int rank  = rank_of(data.root_process_time,
+                                        entry_to_rank->item,
+                                        TYPE_PROCESS_TIME);
+                    int total = node_size(data.root_process_time);
+                    end_query = clock();
                     
-                    end_remove        = clock();
-                    time_spent_remove = (double) (end_remove - start_remove) / CLOCKS_PER_SEC;
+                    printf("Processing time %d seconds, rank %d of %d (%d items are faster, %.1f%%)\n",
+                           entry_to_rank->item->process_time,
+                           rank + 1,
+                           total,
+                           rank,
+                           100.0 * rank / total);
+                    printf("\nTime taken for binary tree: %f milliseconds\n\n",
+                           (double) (end_query - start_query) / CLOCKS_PER_SEC * 1000);
+                    break;
+                
+                case 8:
+                    /* Aggregates are kept up to date by every insertion and removal, so this is O(groups) */
+                    start_query = clock();
+                    print_groups(&data.by_name,
+                                 data.root_process_time);
+                    end_query = clock();
                     
-                    printf("\nTime taken for list: %f milliseconds\n\n",
-                           time_spent_remove * 1000);
+                    printf("\nTime taken for aggregates: %f milliseconds\n\n",
+                           (double) (end_query - start_query) / CLOCKS_PER_SEC * 1000);
+                    break;
+                
+                case 9:
+                    printf("Processing time statistics of a piece id\n");
+                    printf("Piece id: ");
+                    char             piece_to_find[64];
+                    struct aggregate *piece_group = NULL;
+                    if (scanf("%63s",
+                              piece_to_find) == 1 && strlen(piece_to_find) == ID_LENGTH)
+                    {
+                        struct article key;
+                        key.piece_id = pack_id(piece_to_find);
+                        piece_group = group_find(&data.by_piece_id,
+                                                 &key,
+                                                 0);
+                    }
+                    clear_buffer();
                     
-                    printf("\n\nRecord removed successfully\n");
+                    if (piece_group == NULL || piece_group->count == 0)
+                    {
+                        printf("Piece id does not exist\n");
+                        break;
+                    }
                     
+                    start_query = clock();
+                    printf("\n%-20s%8s%10s%8s%8s%8s%8s\n",
+                           "Piece id",
+                           "Items",
+                           "Mean",
+                           "Min",
+                           "Median",
+                           "p95",
+                           "Max");
+                    group_resolve(&data.by_piece_id,
+                                  piece_group,
+                                  data.root_process_time);
+                    print_aggregate(piece_to_find,
+                                    ID_LENGTH,
+                                    piece_group);
+                    end_query = clock();
                     
+                    printf("\nTime taken for aggregates: %f milliseconds\n\n",
+                           (double) (end_query - start_query) / CLOCKS_PER_SEC * 1000);
                     break;
                 
                 default:
@@ -503,9 +1769,25 @@ int main()
         while (choice != 0);
     }
     
+    /* The snapshot is written again only if the data set changed since it was loaded (a replayed log counts as
+     * a change, it is emptied). With a log, saving the snapshot compacts it */
+    if (loaded >= 0 && snapshot_file != NULL && (!from_snapshot || data.changes > 0 || replayed > 0))
+    {
+        int saved = data.log != NULL ? log_compact(&data) : save_snapshot(&data,
+                                                                          snapshot_file);
+        fprintf(batch_file != NULL ? stderr : stdout,
+                saved < 0 ? "Saving the snapshot %s failed\n" : "Snapshot saved in %s\n",
+                snapshot_file);
+    }
+    
+    if (data.log != NULL)
+    {
+        log_commit(&data);
+        log_close(&log);
+    }
+    
     /* Memory de-allocation */
-    free(root_product_id);
-    free(root_process_time);
+    free_data_set(&data);
     
     return 0;
 }
@@ -515,75 +1797,42 @@ int main()
 /* Article functions */
 
 /* The function acquires the data (product_id, name, piece_id, time_entry, time_exit, process_time)
- * and creates a new article, returning it.*/
-struct article *new_article(char *product_id,
-                            char *name,
-                            char *piece_id,
-                            char *time_entry,
-                            char *time_exit,
-                            float process_time)
+ * and creates a new article, returning it. Product id and piece id are already packed with pack_id(),
+ * the name is interned in the given string pool (if any) and the article itself comes from the given memory pool.*/
+struct article *new_article(struct memory_pool *pool,
+                            struct string_pool *names,
+                            uint32_t product_id,
+                            const char *name,
+                            size_t name_length,
+                            uint32_t piece_id,
+                            uint32_t time_entry,
+                            uint32_t time_exit,
+                            int32_t process_time)
 {
-    /* Allocating memory for the new item */
-    struct article *item = (struct article *) malloc(sizeof(struct article));
+    /* Allocating memory for the new item from the articles pool */
+    struct article *item = (struct article *) pool_alloc(pool);
     
     /* Checking for memory allocation errors */
     if (item != NULL)
     {
-        item->product_id = malloc(strlen(product_id) + 1);
-        if (item->product_id == NULL)
+        /* Without a string pool the name is referenced where it is, it must live as long as the article */
+        item->name        = names == NULL ? name : intern_string(names,
+                                                                 name,
+                                                                 name_length);
+        item->name_length = (uint32_t) name_length;
+        if (item->name == NULL)
         {
+            pool_release(pool,
+                         item);
             item = NULL;
-            printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
         }
         else
         {
-            strcpy(item->product_id,
-                   product_id);
-            item->name = malloc(strlen(name) + 1);
-            if (item->name == NULL)
-            {
-                item = NULL;
-                printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
-            }
-            else
-            {
-                strcpy(item->name,
-                       name);
-                item->piece_id = malloc(strlen(piece_id) + 1);
-                if (item->name == NULL)
-                {
-                    item = NULL;
-                    printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
-                }
-                else
-                {
-                    strcpy(item->piece_id,
-                           piece_id);
-                    item->time_entry = malloc(strlen(time_entry) + 1);
-                    if (item->name == NULL)
-                    {
-                        item = NULL;
-                        printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
-                    }
-                    else
-                    {
-                        strcpy(item->time_entry,
-                               time_entry);
-                        item->time_exit = malloc(strlen(time_exit) + 1);
-                        if (item->name == NULL)
-                        {
-                            item = NULL;
-                            printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
-                        }
-                        else
-                        {
-                            strcpy(item->time_exit,
-                                   time_exit);
-                            item->process_time = process_time;
-                        }
-                    }
-                }
-            }
+            item->product_id   = product_id;
+            item->piece_id     = piece_id;
+            item->time_entry   = time_entry;
+            item->time_exit    = time_exit;
+            item->process_time = process_time;
         }
     }
     else
@@ -594,677 +1843,7208 @@ struct article *new_article(char *product_id,
     return item;
 }
 
-/* The function acquires the item and print its data in a formatted way */
+/* The function acquires an article and formats it in the output buffer as a row of the current format.
+ * Ids and times have a fixed width, so every field is copied by hand instead of going through printf() */
 void print_article(struct article *item)
 {
-    printf("%-15s%-20s%-15s%-20s%-20s\n",
-           item->product_id,
-           item->name,
-           item->piece_id,
-           item->time_entry,
-           item->time_exit);
-}
-
-/* Binary tree functions */
-
-/* The function acquires the input file where the data is stored and the binary tree type to insert that data */
-struct node *load_data(const char file[],
-                       int type)
-{
-    /* Initializing tree */
-    struct node *root = NULL;
-    
-    /* Opening input file */
-    FILE *f = fopen(file,
-                    "r");
+    char *row   = output_reserve(128 + item->name_length);
+    char *start = row;
+    char separator = output.format == FORMAT_CSV ? ',' : '\t';
     
-    /* Opening file error */
-    if (f != NULL)
+    if (output.format == FORMAT_COLUMNS)
+    {
+        /* Same layout as "%-15s%-20.*s%-15s%-20s%-20s\n" */
+        memset(row,
+               ' ',
+               90);
+        unpack_id(item->product_id,
+                  row);
+        row[ID_LENGTH] = ' ';
+        memcpy(row + 15,
+               item->name,
+               item->name_length);
+        row += 15 + (item->name_length > 20 ? item->name_length : 20);
+        unpack_id(item->piece_id,
+                  row);
+        row[ID_LENGTH] = ' ';
+        format_time(item->time_entry,
+                    row + 15);
+        row[23] = ' ';
+        format_time(item->time_exit,
+                    row + 35);
+        row[43] = ' ';
+        row += 55;
+    }
+    else
     {
-        char product_id[64], name[64], piece_id[64], time_entry[64], time_exit[64];
+        unpack_id(item->product_id,
+                  row);
+        row += ID_LENGTH;
+        *row++ = separator;
         
-        /* Loading data from file */
-        while (fscanf(f,
-                      "%s %s %s %s %s",
-                      product_id,
-                      name,
-                      piece_id,
-                      time_entry,
-                      time_exit) != EOF)
+        /* In CSV a name with commas or quotes is quoted, and its quotes are doubled */
+        if (output.format == FORMAT_CSV && (memchr(item->name,
+                                                   ',',
+                                                   item->name_length) != NULL || memchr(item->name,
+                                                                                        '"',
+                                                                                        item->name_length) != NULL))
         {
-            /* Creating new article and inserting it in binary tree */
-            struct article *item = new_article(product_id,
-                                               name,
-                                               piece_id,
-                                               time_entry,
-                                               time_exit,
-                                               get_prod_process_time(time_entry,
-                                                                     time_exit));
-            if (item != NULL)
-            {
-                root = insert(root,
-                              item,
-                              type);
-            }
-            else
+            uint32_t i;
+            *row++ = '"';
+            for (i = 0; i < item->name_length; i++)
             {
-                root = NULL;
+                if (item->name[i] == '"')
+                {
+                    *row++ = '"';
+                }
+                *row++ = item->name[i];
             }
+            *row++ = '"';
         }
-        fclose(f);
+        else
+        {
+            memcpy(row,
+                   item->name,
+                   item->name_length);
+            row += item->name_length;
+        }
+        *row++ = separator;
+        
+        unpack_id(item->piece_id,
+                  row);
+        row += ID_LENGTH;
+        *row++ = separator;
+        format_time(item->time_entry,
+                    row);
+        row += 8;
+        *row++ = separator;
+        format_time(item->time_exit,
+                    row);
+        row += 8;
+        *row++ = separator;
+        row = format_number(item->process_time,
+                            row);
     }
     
-    return root;
+    *row++ = '\n';
+    output.used += row - start;
 }
 
-/* The function acquires the item and allocates a new node with the given data.
-It also initialize the node left and right pointers as NULL. Then, the node is returned. */
-struct node *new_node(struct article *item)
+/* The function returns the output format with the given name, -1 if it doesn't exist */
+int parse_format(const char *format)
 {
-    struct node *temp = (struct node *) malloc(sizeof(struct node)); /* Allocate memory for new node */
-    
-    if (temp != NULL)
+    if (strcmp(format,
+               "columns") == 0)
     {
-        temp->item = item; /* Storing the item in the node */
-        temp->left = temp->right = NULL; /* Initialize left and right child as NULL */
+        return FORMAT_COLUMNS;
     }
-    else
+    if (strcmp(format,
+               "csv") == 0)
     {
-        printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+        return FORMAT_CSV;
     }
-    
-    return temp;
+    if (strcmp(format,
+               "tsv") == 0)
+    {
+        return FORMAT_TSV;
+    }
+    return -1;
 }
 
-/* The function acquires a node, an item and the type of data to insert.
-   Then it insert the item into the correct node, and return that node. */
-struct node *insert(struct node *node,
-                    struct article *item,
-                    int type)
+/* The function acquires an id of ID_LENGTH characters and packs it in an integer, first character in the most significant byte.
+ * This way comparing two packed ids as integers gives the same result as comparing them with strcmp() */
+uint32_t pack_id(const char *id)
 {
-    /* If the node is NULL, it is the node where to insert the item */
-    if (node == NULL)
-    {
-        node = new_node(item);
-    }
-    else
+    uint32_t key = 0;
+    int      i;
+    
+    /* Shorter ids are padded with zeros, which sort before every character */
+    for (i = 0; i < ID_LENGTH; i++)
     {
-        /* If the tree is not empty, recur down it to find the correct node to insert the given item.
-           For data comparison between strings, strcmp() is used to get the smaller value */
-        
-        /* The switch statement is used to compare the correct item value */
-        switch (type)
+        key <<= 8;
+        if (*id != '\0')
         {
-            /* The logic behind the insert function is quite simple:
-            if the value to insert is smaller than the current node value then use recursion to insert the value in his left child.
-            Otherwise insert it in his right child */
-            
-            /* Only product id is unique value, so < and > are enough for values comparyson, because duplicate values are not allowed. */
-            case TYPE_PRODUCT_ID:
-                if (strcmp(item->product_id,
-                           node->item->product_id) < 0)
-                {
-                    node->left = insert(node->left,
-                                        item,
-                                        type);
-                }
-                else if (strcmp(item->product_id,
-                                node->item->product_id) > 0)
-                {
-                    node->right = insert(node->right,
-                                         item,
-                                         type);
-                }
-                break;
-                
-                /* process time allow duplicate values, so <= and > are required for values comparyson. */
-            case TYPE_PROCESS_TIME:
-                if (item->process_time <= node->item->process_time)
-                {
-                    node->left = insert(node->left,
-                                        item,
-                                        type);
-                }
-                else if (item->process_time > node->item->process_time)
-                {
-                    node->right = insert(node->right,
-                                         item,
-                                         type);
-                }
-                break;
-            
-            default:
-                break;
+            key |= (unsigned char) *id++;
         }
     }
     
-    return node;
+    return key;
 }
 
-/* The function acquires a node and return his smallest child */
-struct node *min_value_node(struct node *node)
+/* The function acquires a packed id and writes it back as a string of ID_LENGTH characters in the given buffer */
+void unpack_id(uint32_t key,
+               char *id)
 {
-    struct node *temp = node;
+    int i;
     
-    /* Loop down the node until the leftmost child is found*/
-    while (temp->left != NULL)
+    for (i = ID_LENGTH - 1; i >= 0; i--)
     {
-        temp = temp->left;
+        id[i] = (char) (key & 0xFF);
+        key >>= 8;
     }
-    
-    return temp;
+    id[ID_LENGTH] = '\0';
 }
 
-/* The function acquires a node, an item and the type of data to remove.
-   Then it remove the item from the correct tree, and return that tree. */
-struct node *remove_product(struct node *root,
-                            struct article *item,
-                            int type)
+/* Loading functions */
+
+/* The function initializes an empty data set. It returns 0 on success, -1 if memory allocation fails */
+int init_data_set(struct data_set *data)
 {
-    if (root != NULL)
+    data->root_product_id   = NULL;
+    data->root_process_time = NULL;
+    data->mapped_file       = NULL;
+    data->mapped_length     = 0;
+    data->pending           = NULL;
+    data->pending_count     = 0;
+    data->pending_capacity  = 0;
+    data->count             = 0;
+    data->changes           = 0;
+    data->log               = NULL;
+    
+    pool_init(&data->articles,
+              sizeof(struct article));
+    pool_init(&data->list_chunks,
+              sizeof(struct list_chunk));
+    list_init(&data->list_product_id,
+              TYPE_PRODUCT_ID);
+    list_init(&data->list_process_time,
+              TYPE_PROCESS_TIME);
+    
+    if (shared_init(&data->trees,
+                    &data->articles) != 0 || hash_init(&data->ids,
+                                                       1024) != 0 || group_init(&data->by_name,
+                                           64,
+                                           GROUP_BY_NAME) != 0 || group_init(&data->by_piece_id,
+                                                                             1024,
+                                                                             GROUP_BY_PIECE_ID) != 0)
     {
-        /* The switch statement is used to compare the correct item value */
-        switch (type)
-        {
-            case TYPE_PRODUCT_ID:
-                /* If the key to be removed is smaller than the root's key,
-                 * then it lies in left subtree */
-                if (strcmp(item->product_id,
-                           root->item->product_id) < 0)
-                {
-                    root->left = remove_product(root->left,
-                                                item,
-                                                type);
-                }
-                    /* If the key to be removed is greater than the root's key,
-                     * then it lies in right subtree */
-                else if (strcmp(item->product_id,
-                                root->item->product_id) > 0)
-                {
-                    root->right = remove_product(root->right,
-                                                 item,
-                                                 type);
-                }
-                    /* If key is same as root's key, then this is the node to be removed */
-                else
-                {
-                    /* Node with only one child or no child */
-                    if (root->left == NULL)
-                    {
-                        struct node *temp = root->right;
-                        free(root);
-                        return temp;
-                    }
-                    else if (root->right == NULL)
-                    {
-                        struct node *temp = root->left;
-                        free(root);
-                        return temp;
-                    }
-                    
-                    /* Node with two children: get the smallest child the right subtree */
-                    struct node *temp = min_value_node(root->right);
-                    
-                    /* Copy the found node item to this node */
-                    root->item = temp->item;
-                    
-                    /* Deleting the found node */
-                    root->right = remove_product(root->right,
-                                                 temp->item,
-                                                 type);
-                }
-                break;
-            case TYPE_PROCESS_TIME:
-                if (item->process_time < root->item->process_time)
-                {
-                    root->left = remove_product(root->left,
-                                                item,
-                                                type);
-                }
-                else if (item->process_time > root->item->process_time)
-                {
-                    root->right = remove_product(root->right,
-                                                 item,
-                                                 type);
-                }
-                else
-                {
-                    /* Since process time allows duplicate values, an ID comparyson must be done to remove the right item */
-                    if (strcmp(item->product_id,
-                               root->item->product_id) == 0)
-                    {
-                        if (root->left == NULL)
-                        {
-                            struct node *temp = root->right;
-                            free(root);
-                            return temp;
-                        }
-                        else if (root->right == NULL)
-                        {
-                            struct node *temp = root->left;
-                            free(root);
-                            return temp;
-                        }
-                        
-                        struct node *temp = min_value_node(root->right);
-                        root->item  = temp->item;
-                        root->right = remove_product(root->right,
-                                                     temp->item,
-                                                     type);
-                    }
-                    else
-                    {
-                        /* If ID is not the same, then remove the left child of that node (since insert on left child is conditioned by <= ) */
-                        root->left = remove_product(root->left,
-                                                    item,
-                                                    type);
-                    }
-                }
-                break;
-        }
+        return -1;
     }
     
-    return root;
+    return string_pool_init(&data->names,
+                            256);
 }
 
-/* The function acquires the root node and the product_id of the searched element,
-   then search a node that has the given id. It returns the node if the element exists, NULL otherwise */
-
-
-struct node *search_id(struct node *root,
-                       char *id)
+/* The function acquires the input file where the data is stored, the number of threads to use and the data set to fill.
+ * A regular file is mapped in memory and parsed in place: by load_parallel() if it is big enough and more than
+ * one thread is allowed, otherwise by load_mapped(). Pipes and stdin ("-") are read in blocks by load_stream().
+ * Every row is parsed once, a single article is created and shared by both binary trees and both lists.
+ * When the data set is empty the articles are indexed all at once by index_pending(), after the whole file is read.
+ * It returns the number of loaded rows, -1 if the file can't be opened or memory allocation fails. */
+int load_data(const char file[],
+              int threads,
+              struct data_set *data)
 {
-    if (root == NULL)
+    int         count = -1;
+    FILE        *f    = stdin;
+    struct stat info;
+    void        *map  = MAP_FAILED;
+    
+    /* Opening input file */
+    if (strcmp(file,
+               "-") != 0)
     {
-        return NULL;
+        f = fopen(file,
+                  "rb");
+        
+        /* Opening file error */
+        if (f == NULL)
+        {
+            return -1;
+        }
+        
+        if (fstat(fileno(f),
+                  &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+        {
+            map = mmap(NULL,
+                       info.st_size,
+                       PROT_READ,
+                       MAP_PRIVATE,
+                       fileno(f),
+                       0);
+        }
+    }
+    
+    if (map != MAP_FAILED)
+    {
+        /* The mapping is kept until the data set is freed, since names point in it */
+        madvise(map,
+                info.st_size,
+                MADV_SEQUENTIAL);
+        data->mapped_file   = map;
+        data->mapped_length = info.st_size;
+    }
+    
+    if (map != MAP_FAILED && threads > 1 && info.st_size >= PARALLEL_LOAD_MIN_SIZE && data->ids.count == 0)
+    {
+        count = load_parallel((const char *) map,
+                              info.st_size,
+                              threads,
+                              data);
     }
     else
     {
-        if (strcmp(root->item->product_id,
-                   id) == 0)
+        /* Rows loaded in an empty data set are collected in the pending array instead of being inserted one by one */
+        if (data->ids.count == 0)
         {
-            return root;
+            data->pending_capacity = 1024;
+            data->pending_count    = 0;
+            data->pending          = (struct article **) malloc(data->pending_capacity * sizeof(struct article *));
+            if (data->pending == NULL)
+            {
+                printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+            }
         }
-        struct node *tmp;
-        tmp = search_id(root->left,
-                        id);
-        if (tmp)
+        
+        if (data->ids.count > 0 || data->pending != NULL)
         {
-            return tmp;
+            count = map != MAP_FAILED ? load_mapped((const char *) map,
+                                                    info.st_size,
+                                                    data) : load_stream(f,
+                                                                        data);
         }
-        tmp = search_id(root->right,
-                        id);
-        if (tmp)
+        
+        if (data->pending != NULL)
         {
-            return tmp;
+            if (count >= 0 && index_pending(data) != 0)
+            {
+                count = -1;
+            }
+            free(data->pending);
+            data->pending       = NULL;
+            data->pending_count = 0;
         }
     }
-    /* search didn't find anything */
-    return NULL;
-}
-
-/* The function acquires the root and print its data in order */
-void print_tree(struct node *root)
-{
-    if (root != NULL)
+    
+    if (f != stdin)
     {
-        /* Use recursion to elaborate the left child */
-        print_tree(root->left);
-        /* Elaborate node item */
-        print_article(root->item);
-        /* Use recursion to elaborate the right child */
-        print_tree(root->right);
+        fclose(f);
     }
+    
+    return count;
 }
 
-
-
-/* List functions */
-
-/* function to insert a new node in a list. */
-
-struct list_node *insert_in_list(struct list_node *head_ref,
-                                 struct list_node *new_list_node,
-                                 int type)
+/* The function acquires a file mapped in memory and its length, and loads every row in the data set.
+ * Names are not copied: articles point directly in the mapping.
+ * It returns the number of loaded rows, -1 if memory allocation fails. */
+int load_mapped(const char *map,
+                size_t length,
+                struct data_set *data)
 {
-    struct list_node *current;
-    /* The switch statement is used to compare the correct item value */
-    switch (type)
+    long       line_number = 0;
+    const char *next_line;
+    int        count       = load_buffer(data,
+                                         map,
+                                         map + length,
+                                         1,
+                                         &line_number,
+                                         &next_line);
+    
+    /* The last row has no newline: it is copied in a temporary buffer, so its name must be interned */
+    if (count >= 0 && next_line < map + length)
     {
-        case TYPE_PRODUCT_ID:
-            /* Special case for the head end */
-            if (head_ref == NULL || strcmp((head_ref)->item->product_id,
-                                           new_list_node->item->product_id) > 0)
-            {
-                new_list_node->next = head_ref;
-                head_ref = new_list_node;
-            }
-            else
-            {
-                /* Locate the node before the point of insertion */
-                current = head_ref;
-                while (current->next != NULL &&
-                       strcmp(current->next->item->product_id,
-                              new_list_node->item->product_id) < 0)
-                {
-                    current = current->next;
-                }
-                new_list_node->next = current->next;
-                current->next       = new_list_node;
-            }
-            
-            break;
-        
-        case TYPE_PROCESS_TIME:
-            /* Special case for the head end */
-            if (head_ref == NULL || (head_ref)->item->process_time >= new_list_node->item->process_time)
-            {
-                new_list_node->next = head_ref;
-                head_ref = new_list_node;
-            }
-            else
-            {
-                /* Locate the node before the point of insertion */
-                current = head_ref;
-                while (current->next != NULL &&
-                       current->next->item->process_time < new_list_node->item->process_time)
-                {
-                    current = current->next;
-                }
-                new_list_node->next = current->next;
-                current->next       = new_list_node;
-            }
-            break;
+        size_t tail_length = map + length - next_line;
+        char   *tail       = (char *) malloc(tail_length + 1);
+        if (tail == NULL)
+        {
+            printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+            return -1;
+        }
+        memcpy(tail,
+               next_line,
+               tail_length);
+        tail[tail_length] = '\n';
         
-        default:
-            break;
+        int loaded = load_buffer(data,
+                                 tail,
+                                 tail + tail_length + 1,
+                                 0,
+                                 &line_number,
+                                 &next_line);
+        count = loaded < 0 ? -1 : count + loaded;
+        free(tail);
     }
-    return (head_ref);
-}
-
-/* A utility function to create a new list node */
-struct list_node *create_list_node(struct article *item)
-{
-    /* allocate list node */
-    struct list_node *new_list_node = (struct list_node *) malloc(sizeof(struct list_node));
     
-    /* put in the data */
-    new_list_node->item = item;
-    new_list_node->next = NULL;
+    data->count = data->ids.count;
     
-    return new_list_node;
+    return count;
 }
 
-/* Function to print a list */
-void print_list(struct list_node *head)
+/* The function acquires a file mapped in memory, its length and the number of threads, and loads every row
+ * in the empty data set. The file is split in chunks at row boundaries, and every thread parses a chunk and sorts
+ * its articles in two runs (see load_chunk_thread()). The runs are then merged and the indexes are built from the
+ * merged arrays by bulk_load(). Rows whose product id was already loaded by a previous row are skipped.
+ * It returns the number of loaded rows, -1 if memory allocation fails. */
+int load_parallel(const char *map,
+                  size_t length,
+                  int threads,
+                  struct data_set *data)
 {
-    struct list_node *temp = head;
-    while (temp != NULL)
+    struct load_chunk chunks[MAX_LOAD_THREADS];
+    pthread_t         thread_ids[MAX_LOAD_THREADS];
+    int               started[MAX_LOAD_THREADS];
+    const char        *start = map;
+    const char        *end   = map + length;
+    int               i, count = 0, error = 0;
+    
+    if (threads > MAX_LOAD_THREADS)
     {
-        printf("%s, ",
-               temp->item->product_id);
-        temp = temp->next;
+        threads = MAX_LOAD_THREADS;
     }
-}
-
-/* The function acquires the input file where the data is stored and the list type to insert that data */
-struct list_node *load_data_list(const char file[],
-                                 int type)
-{
-    /* Initializing list */
-    struct list_node *head     = NULL;
-    struct list_node *new_node = NULL;
     
+    /* Splitting the file in chunks of about the same size, every chunk ends after a newline */
+    int chunk_count = 0;
+    while (start < end && chunk_count < threads)
+    {
+        const char *chunk_end = chunk_count == threads - 1 ? end : start + (end - start) / (threads - chunk_count);
+        if (chunk_end < end)
+        {
+            const char *newline = memchr(chunk_end,
+                                         '\n',
+                                         end - chunk_end);
+            chunk_end = newline == NULL ? end : newline + 1;
+        }
+        
+        memset(&chunks[chunk_count],
+               0,
+               sizeof(struct load_chunk));
+        chunks[chunk_count].start = start;
+        chunks[chunk_count].end   = chunk_end;
+        chunk_count++;
+        start = chunk_end;
+    }
     
-    /* Opening input file */
-    FILE *f = fopen(file,
-                    "r");
+    /* Parsing and sorting every chunk in its own thread, the first chunk is loaded by this thread */
+    for (i = 1; i < chunk_count; i++)
+    {
+        started[i] = pthread_create(&thread_ids[i],
+                                    NULL,
+                                    load_chunk_thread,
+                                    &chunks[i]) == 0;
+        if (!started[i])
+        {
+            load_chunk_thread(&chunks[i]);
+        }
+    }
+    load_chunk_thread(&chunks[0]);
+    for (i = 1; i < chunk_count; i++)
+    {
+        if (started[i])
+        {
+            pthread_join(thread_ids[i],
+                         NULL);
+        }
+    }
+    
+    /* Reporting skipped rows with their absolute line number, and handing the articles over to the pool */
+    long            first_line = 0;
+    struct article  **runs_by_product_id[MAX_LOAD_THREADS];
+    struct article  **runs_by_process_time[MAX_LOAD_THREADS];
+    int             counts[MAX_LOAD_THREADS];
     
-    /* Opening file error */
-    if (f != NULL)
+    for (i = 0; i < chunk_count; i++)
     {
-        char product_id[64], name[64], piece_id[64], time_entry[64], time_exit[64];
+        int j;
+        for (j = 0; j < chunks[i].warning_count; j++)
+        {
+            fprintf(stderr,
+                    "[WARNING] Line %ld: %s, row skipped\n",
+                    first_line + chunks[i].warnings[j].line_number,
+                    chunks[i].warnings[j].message);
+        }
+        chunks[i].first_line = first_line;
+        first_line += chunks[i].lines;
+        free(chunks[i].warnings);
         
-        /* Loading data from file */
-        while (fscanf(f,
-                      "%s %s %s %s %s",
-                      product_id,
-                      name,
-                      piece_id,
-                      time_entry,
-                      time_exit) != EOF)
+        if (chunks[i].block != NULL)
         {
-            
-            /* Creating new article and inserting it in list */
-            struct article *item = new_article(product_id,
-                                               name,
-                                               piece_id,
-                                               time_entry,
-                                               time_exit,
-                                               get_prod_process_time(time_entry,
-                                                                     time_exit));
-            if (item != NULL)
-            {
-                new_node = create_list_node(item);
-                head     = insert_in_list(head,
-                                          new_node,
-                                          type
-                );
+            pool_adopt(&data->articles,
+                       chunks[i].block,
+                       chunks[i].count);
+        }
+        
+        error |= chunks[i].error;
+        runs_by_product_id[i]   = chunks[i].by_product_id;
+        runs_by_process_time[i] = chunks[i].by_process_time;
+        counts[i]               = chunks[i].count;
+        count += chunks[i].count;
+    }
+    
+    struct article **by_product_id   = NULL;
+    struct article **by_process_time = NULL;
+    
+    if (!error)
+    {
+        by_product_id   = (struct article **) malloc((count + 1) * sizeof(struct article *));
+        by_process_time = (struct article **) malloc((count + 1) * sizeof(struct article *));
+        error = by_product_id == NULL || by_process_time == NULL;
+    }
+    
+    if (!error)
+    {
+        /* Merging the runs by product id. Equal product ids come out in file order, so every duplicate after
+         * the first one is reported and marked with a NULL name, to be skipped by the process time merge */
+        int unique = merge_runs(runs_by_product_id,
+                                counts,
+                                chunk_count,
+                                by_product_id,
+                                TYPE_PRODUCT_ID);
+        
+        int j;
+        for (i = 1, j = 1; i < unique; i++)
+        {
+            if (by_product_id[i]->product_id == by_product_id[j - 1]->product_id)
+            {
+                fprintf(stderr,
+                        "[WARNING] Line %ld: duplicate product id, row skipped\n",
+                        chunk_line(chunks,
+                                   chunk_count,
+                                   by_product_id[i]));
+                by_product_id[i]->name = NULL;
             }
             else
             {
-                new_node = NULL;
+                by_product_id[j++] = by_product_id[i];
             }
         }
-        fclose(f);
+        unique = unique == 0 ? 0 : j;
+        
+        merge_runs(runs_by_process_time,
+                   counts,
+                   chunk_count,
+                   by_process_time,
+                   TYPE_PROCESS_TIME);
+        
+        count = unique;
+        error = bulk_load(data,
+                          by_product_id,
+                          by_process_time,
+                          count) != 0;
+    }
+    
+    for (i = 0; i < chunk_count; i++)
+    {
+        /* Giving the skipped articles back to the pool */
+        int j;
+        for (j = 0; j < chunks[i].count && chunks[i].by_product_id != NULL; j++)
+        {
+            if (chunks[i].by_product_id[j]->name == NULL)
+            {
+                pool_release(&data->articles,
+                             chunks[i].by_product_id[j]);
+            }
+        }
+        
+        free(chunks[i].by_product_id);
+        free(chunks[i].by_process_time);
+        free(chunks[i].line_numbers);
     }
+    free(by_product_id);
+    free(by_process_time);
     
+    data->count = data->ids.count;
     
-    return head;
+    return error ? -1 : count;
 }
 
-void remove_list_item(struct list_node *head,
-                      struct list_node *node_to_remove)
+/* Thread function of load_parallel(): it acquires a load_chunk, parses its rows creating an article for every
+ * valid row, then sorts the articles by product id and by process time with sort_articles() (stable, so equal
+ * product ids stay in file order). Malformed rows are collected
+ * in the warnings of the chunk. Nothing is shared with the other threads. */
+void *load_chunk_thread(void *argument)
 {
-    if (head->next == NULL)
+    struct load_chunk *chunk    = (struct load_chunk *) argument;
+    const char        *line     = chunk->start;
+    int               capacity  = (int) ((chunk->end - chunk->start) / 32) + 16;
+    int               warnings  = 0;
+    
+    chunk->block        = (struct pool_block *) malloc(sizeof(struct pool_block) + capacity * sizeof(struct article));
+    chunk->line_numbers = (long *) malloc(capacity * sizeof(long));
+    if (chunk->block == NULL || chunk->line_numbers == NULL)
     {
-        printf("There is only one node. The list can't be made empty ");
+        chunk->error = 1;
+        return NULL;
     }
-    else
+    struct article *items = (struct article *) (chunk->block + 1);
+    
+    while (line < chunk->end)
     {
-        /* When node to be deleted is head node */
-        if (head == node_to_remove)
-        {
-            /* Copy the item of next node to head */
-            head->item = head->next->item;
-            
-            /* store address of next node */
-            node_to_remove = head->next;
-            
-            /* Remove the link of next node */
-            head->next = head->next->next;
-            
-            /* free memory */
-            free(node_to_remove);
-            
-            return;
-        }
+        const char    *newline = memchr(line,
+                                        '\n',
+                                        chunk->end - line);
+        const char    *line_end = newline == NULL ? chunk->end : newline;
+        struct record record;
+        const char    *error    = NULL;
         
-        /* When not first node, follow the normal deletion process */
+        chunk->lines++;
         
-        /* find the previous node */
-        struct list_node *prev = head;
-        while (prev->next != NULL && prev->next != node_to_remove)
-            prev = prev->next;
-        
-        /* Check if node really exists in Linked List */
-        if (prev->next == NULL)
+        if (line_end > line && !(line_end == line + 1 && *line == '\r'))
         {
-            printf("\n Given node is not present in Linked List");
-            return;
+            error = parse_record(line,
+                                 line_end,
+                                 &record);
+            if (error == NULL)
+            {
+                /* Growing the array of articles, nothing points in it yet */
+                if (chunk->count == capacity)
+                {
+                    capacity *= 2;
+                    struct pool_block *block = (struct pool_block *) realloc(chunk->block,
+                                                                             sizeof(struct pool_block) +
+                                                                             capacity * sizeof(struct article));
+                    if (block == NULL)
+                    {
+                        chunk->error = 1;
+                        break;
+                    }
+                    chunk->block = block;
+                    items        = (struct article *) (block + 1);
+                    
+                    long *line_numbers = (long *) realloc(chunk->line_numbers,
+                                                          capacity * sizeof(long));
+                    if (line_numbers == NULL)
+                    {
+                        chunk->error = 1;
+                        break;
+                    }
+                    chunk->line_numbers = line_numbers;
+                }
+                
+                chunk->line_numbers[chunk->count] = chunk->lines;
+                struct article *item = &items[chunk->count++];
+                item->name         = record.name;
+                item->name_length  = (uint32_t) record.name_length;
+                item->product_id   = record.product_id;
+                item->piece_id     = record.piece_id;
+                item->time_entry   = record.time_entry;
+                item->time_exit    = record.time_exit;
+                item->process_time = record.process_time;
+            }
         }
         
-        /* Remove node from Linked List */
-        prev->next = prev->next->next;
+        if (error != NULL)
+        {
+            if (chunk->warning_count == warnings)
+            {
+                warnings = warnings == 0 ? 16 : warnings * 2;
+                struct load_warning *grown = (struct load_warning *) realloc(chunk->warnings,
+                                                                             warnings * sizeof(struct load_warning));
+                if (grown == NULL)
+                {
+                    chunk->error = 1;
+                    break;
+                }
+                chunk->warnings = grown;
+            }
+            chunk->warnings[chunk->warning_count].line_number = chunk->lines;
+            chunk->warnings[chunk->warning_count].message     = error;
+            chunk->warning_count++;
+        }
         
-        /* Free memory */
-        free(node_to_remove);
+        line = line_end + 1;
+    }
+    
+    /* Sorting the two runs of the chunk */
+    chunk->by_product_id   = (struct article **) malloc((chunk->count + 1) * sizeof(struct article *));
+    chunk->by_process_time = (struct article **) malloc((chunk->count + 1) * sizeof(struct article *));
+    if (chunk->by_product_id == NULL || chunk->by_process_time == NULL)
+    {
+        chunk->error = 1;
+        return NULL;
+    }
+    
+    int i;
+    for (i = 0; i < chunk->count; i++)
+    {
+        chunk->by_product_id[i] = &items[i];
+    }
+    if (sort_articles(chunk->by_product_id,
+                      chunk->count,
+                      TYPE_PRODUCT_ID) != 0)
+    {
+        chunk->error = 1;
+        return NULL;
+    }
+    memcpy(chunk->by_process_time,
+           chunk->by_product_id,
+           chunk->count * sizeof(struct article *));
+    if (sort_articles(chunk->by_process_time,
+                      chunk->count,
+                      TYPE_PROCESS_TIME) != 0)
+    {
+        chunk->error = 1;
     }
-    return;
+    
+    return NULL;
 }
 
-/* Checks whether the value is present in list */
-struct list_node *search_in_list(struct list_node *head,
-                                 char *product_id)
+/* The function acquires the loaded chunks and an article of one of them, and returns the line of the file
+ * the article was read from */
+long chunk_line(struct load_chunk *chunks,
+                int chunk_count,
+                struct article *item)
 {
-    /* Initialize current */
-    struct list_node *current = head;
-    struct list_node *result  = NULL;
-    while (current != NULL)
+    int i;
+    
+    for (i = 0; i < chunk_count; i++)
     {
-        if (strcmp(current->item->product_id,
-                   product_id) == 0)
+        struct article *items = (struct article *) (chunks[i].block + 1);
+        if (chunks[i].block != NULL && (uintptr_t) item >= (uintptr_t) items &&
+            (uintptr_t) item < (uintptr_t) (items + chunks[i].count))
         {
-            result = current;
+            return chunks[i].first_line + chunks[i].line_numbers[item - items];
         }
-        current = current->next;
     }
-    return result;
+    
+    return 0;
 }
 
-
-/* Time functions */
-
-/* This function acquires a string and validates it in the format %H:%M:%S.
- * In case the format has not been respected, it requires the string reinsertion.
- * Checks, if necessary, that the time is after a certain time, this is because
- * the exit time can not be earlier than entry time. */
-void get_valid_time(char *when,
-                    char *bigger_then)
-{
-    struct tm tm_when;
-    int       is_valid = 0;
-    char      *end;
-    do
+/* The function acquires sorted runs of articles (their number and lengths), and merges them in the merged array
+ * with a binary heap of run cursors, in O(n log k). Articles with a NULL name are skipped. Equal keys come out in run order,
+ * so with runs in file order duplicate product ids come out in file order.
+ * It returns the number of merged articles */
+int merge_runs(struct article ***runs,
+               int *counts,
+               int run_count,
+               struct article **merged,
+               int type)
+{
+    int heap[MAX_LOAD_THREADS];  /* Indexes of the runs, ordered by their next article */
+    int next[MAX_LOAD_THREADS];  /* Position of the next article of every run */
+    int size = 0, count = 0, i;
+    
+    for (i = 0; i < run_count; i++)
     {
-        scanf("%s",
-              when);
-        end = strptime(when,
-                       "%H:%M:%S",
-                       &tm_when);
-        if (end == NULL || *end != '\0')
+        next[i] = 0;
+        if (counts[i] > 0)
         {
-            clear_buffer();
-            printf("Time must be expressed as hh:mm:ss format. Please re-insert it: \n");
+            heap[size++] = i;
         }
-        else
+    }
+    
+    /* Heap ordering: by key, then by run index */
+#define RUN_BEFORE(a, b) (compare_items(runs[a][next[a]], runs[b][next[b]], type) < 0 || \
+                          (compare_items(runs[a][next[a]], runs[b][next[b]], type) == 0 && (a) < (b)))
+    
+    for (i = size / 2 - 1; i >= 0; i--)
+    {
+        int parent = i;
+        while (2 * parent + 1 < size)
         {
-            /* Check that the time is after a certain time, this is because
-            * the exit time can not be earlier than entry time. */
-            if (strlen(bigger_then) > 0)
+            int child = 2 * parent + 1;
+            if (child + 1 < size && RUN_BEFORE(heap[child + 1], heap[child]))
             {
-                if (get_prod_process_time(bigger_then,
-                                          when) >= 0)
-                {
-                    is_valid = 1;
-                }
-                else
-                {
-                    clear_buffer();
-                    printf("Time bust be bigger then %s. Please re-insert it: \n",
-                           bigger_then);
-                }
+                child++;
             }
-            else
+            if (!RUN_BEFORE(heap[child], heap[parent]))
             {
-                is_valid = 1;
+                break;
             }
+            int temp = heap[parent];
+            heap[parent] = heap[child];
+            heap[child]  = temp;
+            parent = child;
         }
     }
-    while (!is_valid);
-}
-
-/* This function calculates and returns the processing time in seconds,
- * obtained from the entry time and the exit time, both passed as arguments. */
-double get_prod_process_time(char *time_entry,
-                             char *time_exit)
-{
-    double    diff_t;
-    struct tm tm_entry, tm_exit, *tm_today;
-    time_t    t_entry, t_exit, rawtime;
     
-    strptime(time_entry,
-             "%H:%M:%S",
-             &tm_entry);
-    strptime(time_exit,
+    while (size > 0)
+    {
+        int run = heap[0];
+        
+        if (runs[run][next[run]]->name != NULL)
+        {
+            merged[count++] = runs[run][next[run]];
+        }
+        next[run]++;
+        
+        /* The exhausted run is replaced by the last one, then the top of the heap sifts down */
+        if (next[run] == counts[run])
+        {
+            heap[0] = heap[--size];
+        }
+        
+        int parent = 0;
+        while (2 * parent + 1 < size)
+        {
+            int child = 2 * parent + 1;
+            if (child + 1 < size && RUN_BEFORE(heap[child + 1], heap[child]))
+            {
+                child++;
+            }
+            if (!RUN_BEFORE(heap[child], heap[parent]))
+            {
+                break;
+            }
+            int temp = heap[parent];
+            heap[parent] = heap[child];
+            heap[child]  = temp;
+            parent = child;
+        }
+    }
+#undef RUN_BEFORE
+    
+    return count;
+}
+
+/* The function acquires the empty data set and the same articles sorted by product id and by process time,
+ * and builds every index in O(n): perfectly balanced trees, lists filled chunk by chunk and a hash table
+ * sized for all the articles. It returns 0 on success, -1 if memory allocation fails */
+int bulk_load(struct data_set *data,
+              struct article **by_product_id,
+              struct article **by_process_time,
+              int count)
+{
+    int capacity = data->ids.capacity;
+    while (count * 10 > capacity * 7)
+    {
+        capacity *= 2;
+    }
+    if (hash_resize(&data->ids,
+                    capacity) != 0)
+    {
+        return -1;
+    }
+    
+    if (shared_build(&data->trees,
+                     by_product_id,
+                     by_process_time,
+                     count,
+                     NULL,
+                     0) != 0)
+    {
+        return -1;
+    }
+    update_roots(data);
+    
+    if (build_list(&data->list_chunks,
+                   &data->list_product_id,
+                   by_product_id,
+                   count) != 0 || build_list(&data->list_chunks,
+                                             &data->list_process_time,
+                                             by_process_time,
+                                             count) != 0)
+    {
+        return -1;
+    }
+    
+    /* Registering every article in the hash table and in its aggregates. Articles may be in the table already:
+     * none of them if it is empty, all of them if it holds as many articles as the data set */
+    int i, empty = data->ids.count == 0, full = data->ids.count == count;
+    for (i = 0; i < count; i++)
+    {
+        if ((!full && (empty || hash_search(&data->ids,
+                                            by_product_id[i]->product_id) == NULL) && hash_insert(&data->ids,
+                                                                                                  by_product_id[i]) != 0) ||
+            aggregate_add(data,
+                          by_product_id[i]) != 0)
+        {
+            return -1;
+        }
+    }
+    
+    data->count = data->ids.count;
+    
+    return 0;
+}
+
+/* The function acquires an open stream (a pipe or stdin) and loads every row in the data set.
+ * The stream is read in blocks of READ_BUFFER_SIZE bytes and every complete row of a block is parsed in place,
+ * since the buffer is reused names are interned in the string pool.
+ * It returns the number of loaded rows, -1 if memory allocation fails. */
+int load_stream(FILE *f,
+                struct data_set *data)
+{
+    int  count       = 0;
+    long line_number = 0;
+    
+    char *buffer = (char *) malloc(READ_BUFFER_SIZE);
+    if (buffer == NULL)
+    {
+        printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+        return -1;
+    }
+    
+    size_t length = 0;
+    int    eof    = 0;
+    
+    /* Loading data from file */
+    while (!eof && count >= 0)
+    {
+        size_t read = fread(buffer + length,
+                            1,
+                            READ_BUFFER_SIZE - length,
+                            f);
+        length += read;
+        eof = read == 0;
+        
+        /* At the end of the file the last row may have no newline, it is terminated here */
+        if (eof && length > 0 && buffer[length - 1] != '\n')
+        {
+            if (length == READ_BUFFER_SIZE)
+            {
+                length--;
+            }
+            buffer[length++] = '\n';
+        }
+        
+        const char *next_line;
+        int        loaded = load_buffer(data,
+                                        buffer,
+                                        buffer + length,
+                                        0,
+                                        &line_number,
+                                        &next_line);
+        if (loaded < 0)
+        {
+            count = -1;
+            break;
+        }
+        count += loaded;
+        
+        /* Moving the incomplete last row at the beginning of the buffer. A row that doesn't fit in the
+         * whole buffer is reported and skipped */
+        length -= next_line - buffer;
+        if (length == READ_BUFFER_SIZE)
+        {
+            line_number++;
+            fprintf(stderr,
+                    "[WARNING] Line %ld: row too long, skipped\n",
+                    line_number);
+            
+            int c;
+            while ((c = fgetc(f)) != EOF && c != '\n');
+            length = 0;
+        }
+        memmove(buffer,
+                next_line,
+                length);
+    }
+    
+    free(buffer);
+    
+    data->count = data->ids.count;
+    
+    return count;
+}
+
+/* The function indexes the pending articles of the data set: they are sorted by product id and by process time
+ * with sort_articles() and the indexes are built from the sorted arrays by bulk_load(), in O(n) overall.
+ * It returns 0 on success, -1 if memory allocation fails */
+int index_pending(struct data_set *data)
+{
+    int            count           = data->pending_count;
+    struct article **by_process_time = (struct article **) malloc((count + 1) * sizeof(struct article *));
+    int            result          = -1;
+    
+    if (by_process_time != NULL)
+    {
+        /* Sorting by product id first, the stable sort by process time keeps ties in product id order */
+        if (sort_articles(data->pending,
+                          count,
+                          TYPE_PRODUCT_ID) == 0)
+        {
+            memcpy(by_process_time,
+                   data->pending,
+                   count * sizeof(struct article *));
+            if (sort_articles(by_process_time,
+                              count,
+                              TYPE_PROCESS_TIME) == 0)
+            {
+                result = bulk_load(data,
+                                   data->pending,
+                                   by_process_time,
+                                   count);
+            }
+        }
+    }
+    else
+    {
+        printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+    }
+    
+    free(by_process_time);
+    
+    return result;
+}
+
+/* The function acquires a row of the input file, from line to end (excluded, newline not included),
+ * and splits it in fields separated by spaces or tabs. Ids must have ID_LENGTH characters,
+ * the name at most MAX_NAME_LENGTH characters and times must be in the HH:MM:SS format.
+ * The optional sixth field is the number of midnights crossed by the process (see get_process_time()).
+ * It returns NULL if the row is valid, otherwise a message that describes the error */
+const char *parse_record(const char *line,
+                         const char *end,
+                         struct record *record)
+{
+    const char *fields[6];
+    size_t     lengths[6];
+    int        count = 0;
+    
+    /* Splitting the row, a carriage return at the end of the row is ignored */
+    if (end > line && end[-1] == '\r')
+    {
+        end--;
+    }
+    while (line < end)
+    {
+        if (*line == ' ' || *line == '\t')
+        {
+            line++;
+        }
+        else
+        {
+            const char *field = line;
+            while (line < end && *line != ' ' && *line != '\t')
+            {
+                line++;
+            }
+            if (count == 6)
+            {
+                return "too many fields";
+            }
+            fields[count]  = field;
+            lengths[count] = line - field;
+            count++;
+        }
+    }
+    
+    if (count < 5)
+    {
+        return "missing fields";
+    }
+    if (lengths[0] != ID_LENGTH)
+    {
+        return "product id must have 4 characters";
+    }
+    if (lengths[1] > MAX_NAME_LENGTH)
+    {
+        return "name too long";
+    }
+    if (lengths[2] != ID_LENGTH)
+    {
+        return "piece id must have 4 characters";
+    }
+    
+    record->time_entry = parse_time(fields[3],
+                                    lengths[3]);
+    record->time_exit  = parse_time(fields[4],
+                                    lengths[4]);
+    if (record->time_entry < 0 || record->time_exit < 0)
+    {
+        return "times must be in the HH:MM:SS format";
+    }
+    
+    int days = -1;
+    if (count == 6)
+    {
+        size_t i;
+        for (i = 0, days = 0; i < lengths[5] && days <= MAX_PROCESS_DAYS; i++)
+        {
+            if (fields[5][i] < '0' || fields[5][i] > '9')
+            {
+                return "days must be a number";
+            }
+            days = days * 10 + (fields[5][i] - '0');
+        }
+        if (days > MAX_PROCESS_DAYS)
+        {
+            return "too many days";
+        }
+    }
+    
+    record->process_time = get_process_time(record->time_entry,
+                                            record->time_exit,
+                                            days);
+    if (record->process_time < 0)
+    {
+        return "exit time is earlier than entry time";
+    }
+    
+    record->product_id  = pack_id(fields[0]);
+    record->name        = fields[1];
+    record->name_length = lengths[1];
+    record->piece_id    = pack_id(fields[2]);
+    
+    return NULL;
+}
+
+/* The function acquires a buffer of rows, from buffer to end, and loads every complete row (ended by a newline)
+ * in the data set. Malformed rows and duplicate product ids are reported with their line number and skipped.
+ * With zero_copy the names of the new articles point in the buffer, otherwise they are interned.
+ * The beginning of the first incomplete row is stored in next_line.
+ * It returns the number of loaded rows, -1 if memory allocation fails */
+int load_buffer(struct data_set *data,
+                const char *buffer,
+                const char *end,
+                int zero_copy,
+                long *line_number,
+                const char **next_line)
+{
+    int        count = 0;
+    const char *line = buffer;
+    const char *newline;
+    
+    while (line < end && (newline = memchr(line,
+                                           '\n',
+                                           end - line)) != NULL)
+    {
+        struct record record;
+        const char    *error;
+        
+        (*line_number)++;
+        
+        /* Empty rows are allowed */
+        if (newline == line || (newline == line + 1 && *line == '\r'))
+        {
+            error = NULL;
+        }
+        else if ((error = parse_record(line,
+                                       newline,
+                                       &record)) == NULL)
+        {
+            /* Product id is unique, so rows with an already loaded product id are skipped */
+            if (hash_search(&data->ids,
+                            record.product_id) != NULL)
+            {
+                error = "duplicate product id";
+            }
+            else
+            {
+                /* Creating new article and inserting it in every binary tree and every list */
+                struct article *item = new_article(&data->articles,
+                                                   zero_copy ? NULL : &data->names,
+                                                   record.product_id,
+                                                   record.name,
+                                                   record.name_length,
+                                                   record.piece_id,
+                                                   record.time_entry,
+                                                   record.time_exit,
+                                                   record.process_time);
+                if (item == NULL)
+                {
+                    return -1;
+                }
+                
+                if (data->pending == NULL)
+                {
+                    if (insert_article(data,
+                                       item) != 0)
+                    {
+                        return -1;
+                    }
+                }
+                else
+                {
+                    /* Bulk load: the article is only registered in the hash table, to find duplicates */
+                    if (data->pending_count == data->pending_capacity)
+                    {
+                        struct article **pending = (struct article **) realloc(data->pending,
+                                                                               2 * data->pending_capacity *
+                                                                               sizeof(struct article *));
+                        if (pending == NULL)
+                        {
+                            printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+                            return -1;
+                        }
+                        data->pending          = pending;
+                        data->pending_capacity *= 2;
+                    }
+                    data->pending[data->pending_count++] = item;
+                    
+                    if (hash_insert(&data->ids,
+                                    item) != 0)
+                    {
+                        return -1;
+                    }
+                }
+                count++;
+            }
+        }
+        
+        if (error != NULL)
+        {
+            fprintf(stderr,
+                    "[WARNING] Line %ld: %s, row skipped\n",
+                    *line_number,
+                    error);
+        }
+        
+        line = newline + 1;
+    }
+    
+    *next_line = line;
+    
+    return count;
+}
+
+/* The function inserts an article in both binary trees, both lists, the product id hash table and the aggregates,
+ * and counts it in the data set. It returns 0 on success, -1 if memory allocation fails */
+int insert_article(struct data_set *data,
+                   struct article *item)
+{
+    if (shared_insert(&data->trees,
+                      item) != 0)
+    {
+        return -1;
+    }
+    update_roots(data);
+    
+    if (insert_in_list(&data->list_chunks,
+                       &data->list_product_id,
+                       item) != 0 || insert_in_list(&data->list_chunks,
+                                                    &data->list_process_time,
+                                                    item) != 0)
+    {
+        return -1;
+    }
+    
+    if (hash_insert(&data->ids,
+                    item) != 0)
+    {
+        return -1;
+    }
+    data->count++;
+    data->changes++;
+    
+    return aggregate_add(data,
+                         item);
+}
+
+/* The function removes an article from both binary trees, both lists, the product id hash table
+ * and the aggregates. The article is retired by the trees: it goes back to the articles pool once no reader
+ * of an older version can reach it, so it can still be used until the next change */
+void remove_article(struct data_set *data,
+                    struct article *item)
+{
+    struct hash_entry *entry = hash_search(&data->ids,
+                                           item->product_id);
+    
+    if (shared_remove(&data->trees,
+                      item->product_id) != 0)
+    {
+        char id[ID_LENGTH + 1];
+        unpack_id(item->product_id,
+                  id);
+        fprintf(stderr,
+                "[WARNING] Product id %s is missing from the trees\n",
+                id);
+    }
+    update_roots(data);
+    if (remove_list_item(&data->list_chunks,
+                         &data->list_product_id,
+                         item) != 0 || remove_list_item(&data->list_chunks,
+                                                        &data->list_process_time,
+                                                        item) != 0)
+    {
+        char id[ID_LENGTH + 1];
+        unpack_id(item->product_id,
+                  id);
+        fprintf(stderr,
+                "[WARNING] Product id %s is missing from a list\n",
+                id);
+    }
+    if (entry != NULL)
+    {
+        hash_remove(&data->ids,
+                    entry);
+    }
+    aggregate_remove(data,
+                     item);
+    
+    data->count--;
+    data->changes++;
+}
+
+/* The function copies the roots of the current version of the shared trees in the data set, after a change */
+void update_roots(struct data_set *data)
+{
+    struct index_version *version = atomic_load(&data->trees.version);
+    
+    data->root_product_id   = version->root_product_id;
+    data->root_process_time = version->root_process_time;
+}
+
+/* The function releases every index of the data set and every article.
+ * Objects are never freed one by one: each pool releases its blocks, so the cost is O(number of blocks) */
+void free_data_set(struct data_set *data)
+{
+    shared_free(&data->trees);
+    pool_destroy(&data->articles);
+    pool_destroy(&data->list_chunks);
+    list_free(&data->list_product_id);
+    list_free(&data->list_process_time);
+    hash_free(&data->ids);
+    group_free(&data->by_name);
+    group_free(&data->by_piece_id);
+    string_pool_free(&data->names);
+    
+    if (data->mapped_file != NULL)
+    {
+        munmap(data->mapped_file,
+               data->mapped_length);
+        data->mapped_file   = NULL;
+        data->mapped_length = 0;
+    }
+    
+    data->root_product_id   = NULL;
+    data->root_process_time = NULL;
+    data->count             = 0;
+}
+
+/* The function prints the number of objects and blocks of every memory pool and the peak resident set size */
+void print_memory_report(struct data_set *data)
+{
+    struct rusage usage;
+    
+    getrusage(RUSAGE_SELF,
+              &usage);
+    
+    printf("Memory: %ld articles, %ld tree nodes, %ld list chunks in %ld blocks, peak RSS %ld kB\n",
+           data->articles.objects + data->articles.mapped_objects,
+           data->trees.nodes.objects,
+           data->list_chunks.objects,
+           data->articles.block_count + data->trees.nodes.block_count + data->list_chunks.block_count,
+           usage.ru_maxrss);
+}
+
+/* Snapshot functions */
+
+/* The function writes every article of the data set in a snapshot file, with the order of the two indexes already
+ * sorted. The file is written next to the given one and renamed over it, so a failure never leaves half a snapshot.
+ * The header is written again at the end, with the checksum of everything after it.
+ * It returns the number of saved articles, -1 if the file can't be written or memory allocation fails */
+int save_snapshot(struct data_set *data,
+                  const char *file)
+{
+    struct snapshot_header header;
+    struct article         **by_product_id   = (struct article **) malloc((data->count + 1) * sizeof(struct article *));
+    struct article         **by_process_time = (struct article **) malloc((data->count + 1) * sizeof(struct article *));
+    uint64_t               *pairs            = (uint64_t *) malloc((data->count + 1) * sizeof(uint64_t));
+    uint32_t               *positions        = (uint32_t *) malloc(((size_t) data->ids.capacity + data->count + 1) *
+                                                                   sizeof(uint32_t));
+    size_t                 length            = strlen(file);
+    char                   *temporary        = (char *) malloc(length + 5);
+    FILE                   *f                = NULL;
+    uint64_t               names_length      = 0;
+    uint32_t               crc               = 0;
+    uint32_t               i, count;
+    int                    error             = 0;
+    
+    if (by_product_id == NULL || by_process_time == NULL || pairs == NULL || positions == NULL || temporary == NULL)
+    {
+        printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+        free(by_product_id);
+        free(by_process_time);
+        free(pairs);
+        free(positions);
+        free(temporary);
+        return -1;
+    }
+    memcpy(temporary,
+           file,
+           length);
+    memcpy(temporary + length,
+           ".tmp",
+           5);
+    
+    memset(&header,
+           0,
+           sizeof(header));
+    memcpy(header.magic,
+           SNAPSHOT_MAGIC,
+           sizeof(SNAPSHOT_MAGIC));
+    header.version      = SNAPSHOT_VERSION;
+    header.byte_order   = SNAPSHOT_BYTE_ORDER;
+    header.article_size = sizeof(struct article);
+    header.count        = (uint32_t) list_to_array(&data->list_product_id,
+                                                   by_product_id);
+    list_to_array(&data->list_process_time,
+                  by_process_time);
+    for (i = 0; i < header.count; i++)
+    {
+        names_length += by_product_id[i]->name_length;
+    }
+    header.articles_offset        = sizeof(header);
+    header.by_process_time_offset = header.articles_offset + (uint64_t) header.count * sizeof(struct article);
+    header.hash_offset            = header.by_process_time_offset + (uint64_t) header.count * sizeof(uint32_t);
+    header.hash_capacity          = (uint64_t) data->ids.capacity;
+    header.names_offset           = header.hash_offset + header.hash_capacity * sizeof(uint32_t);
+    header.names_length           = names_length;
+    header.file_length            = header.names_offset + names_length;
+    
+    f = fopen(temporary,
+              "wb");
+    if (f == NULL)
+    {
+        free(by_product_id);
+        free(by_process_time);
+        free(pairs);
+        free(positions);
+        free(temporary);
+        return -1;
+    }
+    error |= fwrite(&header,
+                    sizeof(header),
+                    1,
+                    f) != 1;
+    
+    /* Articles in product id order, each name is replaced by its offset in the names */
+    names_length = 0;
+    for (i = 0; i < header.count && !error; i++)
+    {
+        struct article item = *by_product_id[i];
+        item.name = (const char *) (uintptr_t) names_length;
+        names_length += item.name_length;
+        error |= snapshot_write(f,
+                                &item,
+                                sizeof(item),
+                                1,
+                                &crc);
+    }
+    
+    /* Positions in process time order and in the hash table: sorting the product ids of the articles of every place
+     * tells that the k-th of them is the article at position k */
+    for (i = 0; i < header.count; i++)
+    {
+        pairs[i] = (uint64_t) by_process_time[i]->product_id << 32 | i;
+    }
+    error |= snapshot_positions(pairs,
+                                header.count,
+                                positions) != 0 || snapshot_write(f,
+                                                                  positions,
+                                                                  sizeof(uint32_t),
+                                                                  header.count,
+                                                                  &crc);
+    
+    for (i = 0, count = 0; i < header.hash_capacity && count < header.count; i++)
+    {
+        if (data->ids.entries[i].item != NULL)
+        {
+            pairs[count++] = (uint64_t) data->ids.entries[i].item->product_id << 32 | i;
+        }
+    }
+    memset(positions,
+           0xFF,
+           header.hash_capacity * sizeof(uint32_t));
+    error |= count != header.count || snapshot_positions(pairs,
+                                                          count,
+                                                          positions) != 0 || snapshot_write(f,
+                                                                                            positions,
+                                                                                            sizeof(uint32_t),
+                                                                                            header.hash_capacity,
+                                                                                            &crc);
+    
+    for (i = 0; i < header.count && !error; i++)
+    {
+        error |= snapshot_write(f,
+                                by_product_id[i]->name,
+                                1,
+                                by_product_id[i]->name_length,
+                                &crc);
+    }
+    
+    header.checksum = crc;
+    error |= fseek(f,
+                   0,
+                   SEEK_SET) != 0 || fwrite(&header,
+                                            sizeof(header),
+                                            1,
+                                            f) != 1;
+    
+    /* The file must be on the disk before it replaces the old snapshot, the log is emptied after that */
+    error |= fflush(f) != 0 || fsync(fileno(f)) != 0;
+    error |= fclose(f) != 0;
+    if (!error)
+    {
+        error = rename(temporary,
+                       file) != 0;
+    }
+    if (error)
+    {
+        remove(temporary);
+    }
+    
+    free(by_product_id);
+    free(by_process_time);
+    free(pairs);
+    free(positions);
+    free(temporary);
+    
+    if (error)
+    {
+        return -1;
+    }
+    data->changes = 0;
+    
+    return (int) header.count;
+}
+
+/* The function writes count objects of the given size in the snapshot file and adds them to its checksum.
+ * It returns 0 on success, 1 on error */
+static int snapshot_write(FILE *f,
+                          const void *bytes,
+                          size_t size,
+                          size_t count,
+                          uint32_t *crc)
+{
+    *crc = crc32(*crc,
+                 bytes,
+                 size * count);
+    
+    return fwrite(bytes,
+                  size,
+                  count,
+                  f) != count;
+}
+
+/* The function acquires pairs of a product id (high 32 bits) and a place (low 32 bits), one for every article,
+ * and sorts them by product id with an LSD radix sort, one byte per pass: the article of the k-th pair is the one
+ * at position k in product id order, so positions[place] = k. It returns 0 on success, -1 if memory allocation fails */
+static int snapshot_positions(uint64_t *pairs,
+                              uint32_t count,
+                              uint32_t *positions)
+{
+    uint64_t *scratch = (uint64_t *) malloc(((size_t) count + 1) * sizeof(uint64_t));
+    uint64_t *from    = pairs;
+    uint64_t *to      = scratch;
+    uint32_t i;
+    int      shift;
+    
+    if (scratch == NULL)
+    {
+        printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+        return -1;
+    }
+    
+    for (shift = 32; shift < 64; shift += 8)
+    {
+        uint32_t buckets[256] = {0};
+        uint32_t position     = 0;
+        
+        for (i = 0; i < count; i++)
+        {
+            buckets[from[i] >> shift & 0xFF]++;
+        }
+        for (i = 0; i < 256; i++)
+        {
+            uint32_t bucket = buckets[i];
+            buckets[i] = position;
+            position += bucket;
+        }
+        for (i = 0; i < count; i++)
+        {
+            to[buckets[from[i] >> shift & 0xFF]++] = from[i];
+        }
+        
+        uint64_t *temp = from;
+        from = to;
+        to   = temp;
+    }
+    
+    for (i = 0; i < count; i++)
+    {
+        positions[(uint32_t) from[i]] = i;
+    }
+    free(scratch);
+    
+    return 0;
+}
+
+/* The function maps a snapshot file in memory and builds every index of the empty data set from it.
+ * The articles are used where they are in the mapping (it is private, so changing them doesn't change the file):
+ * only the names are turned from offsets back into pointers. The snapshot saves the sorting and the hashing, not the
+ * indexes: tree nodes and list chunks hold pointers, so they are still allocated and linked again, in O(n).
+ * Before anything is used the checksum is checked, and so is every saved order: the articles must be sorted by
+ * product id with no duplicates, and the process time positions and the hash slots must each be a permutation.
+ * It returns the number of loaded articles, -2 if the file doesn't exist, -1 if it is not a valid snapshot
+ * or memory allocation fails */
+int load_snapshot(const char *file,
+                  struct data_set *data)
+{
+    struct snapshot_header header;
+    struct stat            info;
+    struct article         **by_product_id   = NULL;
+    struct article         **by_process_time = NULL;
+    struct hash_table      ids               = {NULL, 0, 0};
+    unsigned char          *seen             = NULL;
+    uint32_t               *ranks            = NULL;
+    uint64_t               *keys             = NULL;
+    const char             *error            = NULL;
+    char                   *map;
+    int                    descriptor        = open(file,
+                                                    O_RDONLY);
+    uint32_t               i;
+    
+    if (descriptor < 0)
+    {
+        return -2;
+    }
+    if (fstat(descriptor,
+              &info) != 0 || info.st_size < (off_t) sizeof(header))
+    {
+        close(descriptor);
+        fprintf(stderr,
+                "[WARNING] %s: not a snapshot\n",
+                file);
+        return -1;
+    }
+    
+    map = (char *) mmap(NULL,
+                        info.st_size,
+                        PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE,
+                        descriptor,
+                        0);
+    close(descriptor);
+    if (map == MAP_FAILED)
+    {
+        return -1;
+    }
+    
+    /* Checking the header, then every offset stored in the file */
+    memcpy(&header,
+           map,
+           sizeof(header));
+    if (memcmp(header.magic,
+               SNAPSHOT_MAGIC,
+               sizeof(SNAPSHOT_MAGIC)) != 0)
+    {
+        error = "not a snapshot";
+    }
+    else if (header.version != SNAPSHOT_VERSION || header.byte_order != SNAPSHOT_BYTE_ORDER ||
+             header.article_size != sizeof(struct article))
+    {
+        error = "snapshot written by another version or another kind of machine";
+    }
+    else if (header.file_length != (uint64_t) info.st_size || header.count > INT_MAX ||
+             header.by_process_time_offset != header.articles_offset + (uint64_t) header.count * sizeof(struct article) ||
+             header.hash_offset != header.by_process_time_offset + (uint64_t) header.count * sizeof(uint32_t) ||
+             header.hash_capacity > (1u << 30) || (header.hash_capacity & (header.hash_capacity - 1)) != 0 ||
+             header.hash_capacity * 7 < (uint64_t) header.count * 10 ||
+             header.names_offset != header.hash_offset + header.hash_capacity * sizeof(uint32_t) ||
+             header.names_offset + header.names_length != header.file_length || header.articles_offset % 8 != 0)
+    {
+        error = "truncated or corrupted snapshot";
+    }
+    else if (crc32(0,
+                   map + sizeof(header),
+                   header.file_length - sizeof(header)) != header.checksum)
+    {
+        error = "corrupted snapshot, wrong checksum";
+    }
+    else
+    {
+        by_product_id   = (struct article **) malloc(((size_t) header.count + 1) * sizeof(struct article *));
+        by_process_time = (struct article **) malloc(((size_t) header.count + 1) * sizeof(struct article *));
+        seen            = (unsigned char *) calloc((size_t) header.count + 1,
+                                                   1);
+        ranks           = (uint32_t *) malloc(((size_t) header.count + 1) * sizeof(uint32_t));
+        keys            = (uint64_t *) malloc(((size_t) header.count + 1) * sizeof(uint64_t));
+        if (by_product_id == NULL || by_process_time == NULL || seen == NULL || ranks == NULL || keys == NULL)
+        {
+            printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+            error = "";
+        }
+        else if (hash_init(&ids,
+                           (int) header.hash_capacity) != 0)
+        {
+            error = "";
+        }
+    }
+    
+    if (error == NULL)
+    {
+        struct article *articles = (struct article *) (map + header.articles_offset);
+        uint32_t       *times    = (uint32_t *) (map + header.by_process_time_offset);
+        
+        /* A position seen twice is marked with bit 1 in process time order, with bit 2 in the hash table */
+        for (i = 0; i < header.count; i++)
+        {
+            uintptr_t offset = (uintptr_t) articles[i].name;
+            if (offset + articles[i].name_length > header.names_length ||
+                (i > 0 && articles[i].product_id <= articles[i - 1].product_id) ||
+                times[i] >= header.count || (seen[times[i]] & 1))
+            {
+                error = "corrupted snapshot, wrong order";
+                break;
+            }
+            articles[i].name   = map + header.names_offset + offset;
+            seen[times[i]]    |= 1;
+            ranks[times[i]]    = i;
+            by_product_id[i]   = &articles[i];
+            by_process_time[i] = &articles[times[i]];
+        }
+        
+        /* The keys (process time, product id) are placed in process time order walking the articles in their order:
+         * following the pointers in process time order would visit the articles at random, about 8 times slower.
+         * The sign bit is flipped so that negative process times come first in unsigned order */
+        for (i = 0; i < header.count && error == NULL; i++)
+        {
+            keys[ranks[i]] = (uint64_t) ((uint32_t) articles[i].process_time ^ 0x80000000u) << 32 | articles[i].product_id;
+        }
+        for (i = 1; i < header.count && error == NULL; i++)
+        {
+            if (keys[i - 1] >= keys[i])
+            {
+                error = "corrupted snapshot, wrong order";
+            }
+        }
+        
+        /* The hash table gets back the same slots, so it needs no hashing */
+        uint32_t *slots = (uint32_t *) (map + header.hash_offset);
+        for (i = 0; i < header.hash_capacity && error == NULL; i++)
+        {
+            if (slots[i] != UINT32_MAX)
+            {
+                if (slots[i] >= header.count || (seen[slots[i]] & 2))
+                {
+                    error = "corrupted snapshot, wrong hash table";
+                    break;
+                }
+                seen[slots[i]]     |= 2;
+                ids.entries[i].item = &articles[slots[i]];
+                ids.count++;
+            }
+        }
+        if (error == NULL && (uint32_t) ids.count != header.count)
+        {
+            error = "truncated or corrupted snapshot";
+        }
+    }
+    
+    if (error != NULL)
+    {
+        if (*error != '\0')
+        {
+            fprintf(stderr,
+                    "[WARNING] %s: %s\n",
+                    file,
+                    error);
+        }
+        free(by_product_id);
+        free(by_process_time);
+        free(seen);
+        free(ranks);
+        free(keys);
+        munmap(map,
+               info.st_size);
+        hash_free(&ids);
+        return -1;
+    }
+    free(seen);
+    free(ranks);
+    free(keys);
+    
+    /* The mapping is kept until the data set is freed, since the articles are in it */
+    hash_free(&data->ids);
+    data->ids           = ids;
+    data->mapped_file   = map;
+    data->mapped_length = info.st_size;
+    pool_map(&data->articles,
+             map + header.articles_offset,
+             header.count);
+    
+    int failed = bulk_load(data,
+                           by_product_id,
+                           by_process_time,
+                           (int) header.count);
+    
+    free(by_product_id);
+    free(by_process_time);
+    
+    return failed ? -1 : (int) header.count;
+}
+
+
+/* Log functions */
+
+/* The function opens the log file (creating it if it doesn't exist) and replays its records on the loaded data set:
+ * every insertion and removal recorded since the data set was saved is made again, in the same order.
+ * A group that was being written when the program stopped fails the CRC check: the log is cut at its first record.
+ * Only operations that succeeded are recorded, so replaying records that the data set already holds changes nothing.
+ * It returns the number of replayed records, -1 if the file is not a log or it can't be read or written */
+long log_open(struct write_ahead_log *log,
+              const char *file,
+              const char *snapshot_file,
+              struct data_set *data)
+{
+    struct log_header header;
+    struct stat       info;
+    const char        *error   = NULL;
+    char              *map     = NULL;
+    off_t             offset   = sizeof(header);
+    long              replayed = 0;
+    
+    log->descriptor    = open(file,
+                              O_RDWR | O_CREAT,
+                              0644);
+    log->file          = file;
+    log->snapshot_file = snapshot_file;
+    log->capacity      = LOG_GROUP_BYTES + sizeof(struct log_record) + MAX_NAME_LENGTH;
+    log->buffer        = (char *) malloc(log->capacity);
+    log->used          = 0;
+    log->pending       = 0;
+    log->first_pending = 0;
+    log->size          = 0;
+    log->compact_size  = LOG_COMPACT_BYTES;
+    log->timer_started = 0;
+    log->closing       = 0;
+    pthread_mutex_init(&log->lock,
+                       NULL);
+    
+    /* The timer waits on the same clock as now_ns() */
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes,
+                              CLOCK_MONOTONIC);
+    pthread_cond_init(&log->wake,
+                      &attributes);
+    pthread_condattr_destroy(&attributes);
+    
+    if (log->buffer == NULL)
+    {
+        printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+        error = "";
+    }
+    else if (log->descriptor < 0 || fstat(log->descriptor,
+                                          &info) != 0)
+    {
+        error = strerror(errno);
+    }
+    else if (info.st_size == 0)
+    {
+        /* A new log has only the header */
+        memset(&header,
+               0,
+               sizeof(header));
+        memcpy(header.magic,
+               LOG_MAGIC,
+               sizeof(LOG_MAGIC));
+        header.version    = LOG_VERSION;
+        header.byte_order = SNAPSHOT_BYTE_ORDER;
+        if (write(log->descriptor,
+                  &header,
+                  sizeof(header)) != (ssize_t) sizeof(header) || fsync(log->descriptor) != 0)
+        {
+            error = strerror(errno);
+        }
+        info.st_size = sizeof(header);
+    }
+    else if (info.st_size < (off_t) sizeof(header))
+    {
+        error = "not a log";
+    }
+    else
+    {
+        map = (char *) mmap(NULL,
+                            info.st_size,
+                            PROT_READ,
+                            MAP_PRIVATE,
+                            log->descriptor,
+                            0);
+        if (map == MAP_FAILED)
+        {
+            map   = NULL;
+            error = strerror(errno);
+        }
+        else
+        {
+            memcpy(&header,
+                   map,
+                   sizeof(header));
+            if (memcmp(header.magic,
+                       LOG_MAGIC,
+                       sizeof(LOG_MAGIC)) != 0)
+            {
+                error = "not a log";
+            }
+            else if (header.version != LOG_VERSION || header.byte_order != SNAPSHOT_BYTE_ORDER)
+            {
+                error = "log written by another version or another kind of machine";
+            }
+        }
+    }
+    
+    /* Replaying the records, up to the end of the file or up to the first broken one */
+    while (error == NULL && map != NULL && offset + (off_t) sizeof(struct log_record) <= info.st_size)
+    {
+        struct log_record record;
+        const char        *name = map + offset + sizeof(record);
+        
+        memcpy(&record,
+               map + offset,
+               sizeof(record));
+        if (record.name_length > MAX_NAME_LENGTH ||
+            offset + (off_t) (sizeof(record) + record.name_length) > info.st_size ||
+            crc32(crc32(0,
+                        (const char *) &record + sizeof(record.crc),
+                        sizeof(record) - sizeof(record.crc)),
+                  name,
+                  record.name_length) != record.crc ||
+            (record.operation != LOG_INSERT && record.operation != LOG_REMOVE))
+        {
+            break;
+        }
+        
+        struct hash_entry *entry = hash_search(&data->ids,
+                                               record.product_id);
+        if (record.operation == LOG_INSERT && entry == NULL)
+        {
+            struct article *item = new_article(&data->articles,
+                                               &data->names,
+                                               record.product_id,
+                                               name,
+                                               record.name_length,
+                                               record.piece_id,
+                                               record.time_entry,
+                                               record.time_exit,
+                                               record.process_time);
+            if (item == NULL || insert_article(data,
+                                               item) != 0)
+            {
+                error = "";
+                break;
+            }
+        }
+        else if (record.operation == LOG_REMOVE && entry != NULL)
+        {
+            remove_article(data,
+                           entry->item);
+        }
+        
+        offset += sizeof(record) + record.name_length;
+        replayed++;
+    }
+    
+    if (error == NULL && offset < info.st_size)
+    {
+        fprintf(stderr,
+                "[WARNING] %s: broken record at byte %lld, the log is cut there\n",
+                file,
+                (long long) offset);
+        if (ftruncate(log->descriptor,
+                      offset) != 0 || fsync(log->descriptor) != 0)
+        {
+            error = strerror(errno);
+        }
+    }
+    if (map != NULL)
+    {
+        munmap(map,
+               info.st_size);
+    }
+    
+    if (error != NULL)
+    {
+        if (*error != '\0')
+        {
+            fprintf(stderr,
+                    "[WARNING] %s: %s\n",
+                    file,
+                    error);
+        }
+        log_close(log);
+        return -1;
+    }
+    
+    log->size = offset;
+    data->log = log;
+    
+    /* Without the timer a group is still committed when it is full, old or synced, at the next append */
+    log->timer_started = pthread_create(&log->timer,
+                                        NULL,
+                                        log_timer,
+                                        log) == 0;
+    
+    return replayed;
+}
+
+/* The function writes the records of the current group at the end of the log and waits for them to reach the disk,
+ * with the lock of the log held. A failed write is cut from the file, so the group can be written again later.
+ * It returns 0 on success (always without records), -1 on error */
+static int commit_group(struct write_ahead_log *log)
+{
+    if (log->pending == 0)
+    {
+        return 0;
+    }
+    
+    ssize_t written = pwrite(log->descriptor,
+                             log->buffer,
+                             log->used,
+                             log->size);
+    if (written != (ssize_t) log->used || fdatasync(log->descriptor) != 0)
+    {
+        fprintf(stderr,
+                "[WARNING] %s: %s\n",
+                log->file,
+                written >= 0 && written < (ssize_t) log->used ? "disk full" : strerror(errno));
+        if (ftruncate(log->descriptor,
+                      log->size) != 0)
+        {
+            fprintf(stderr,
+                    "[WARNING] %s: a broken group stays at the end of the log\n",
+                    log->file);
+        }
+        return -1;
+    }
+    
+    log->size    += log->used;
+    log->used    = 0;
+    log->pending = 0;
+    
+    return 0;
+}
+
+/* The function records an insertion or a removal of the article in the log, before it is made in the data set.
+ * The record joins the current group, which is committed when it is full or old enough, or right away with sync.
+ * If the record can't be committed it is dropped, so the operation must not be made.
+ * It returns 0 on success (always without a log), -1 if the log can't be written */
+int log_append(struct data_set *data,
+               int operation,
+               struct article *item,
+               int sync)
+{
+    struct write_ahead_log *log = data->log;
+    struct log_record      record;
+    
+    if (log == NULL)
+    {
+        return 0;
+    }
+    
+    pthread_mutex_lock(&log->lock);
+    
+    /* After a failed commit the buffer may be full, the group is written again first */
+    if (log->used + sizeof(record) + item->name_length > log->capacity && commit_group(log) != 0)
+    {
+        pthread_mutex_unlock(&log->lock);
+        return -1;
+    }
+    
+    memset(&record,
+           0,
+           sizeof(record));
+    record.operation  = operation;
+    record.product_id = item->product_id;
+    if (operation == LOG_INSERT)
+    {
+        record.piece_id     = item->piece_id;
+        record.time_entry   = item->time_entry;
+        record.time_exit    = item->time_exit;
+        record.process_time = item->process_time;
+        record.name_length  = item->name_length;
+    }
+    record.crc = crc32(crc32(0,
+                             (const char *) &record + sizeof(record.crc),
+                             sizeof(record) - sizeof(record.crc)),
+                       item->name,
+                       record.name_length);
+    
+    memcpy(log->buffer + log->used,
+           &record,
+           sizeof(record));
+    memcpy(log->buffer + log->used + sizeof(record),
+           item->name,
+           record.name_length);
+    log->used += sizeof(record) + record.name_length;
+    if (log->pending++ == 0)
+    {
+        log->first_pending = now_ns();
+        pthread_cond_signal(&log->wake);
+    }
+    
+    if ((sync || log->pending >= LOG_GROUP_RECORDS || log->used >= LOG_GROUP_BYTES ||
+         now_ns() - log->first_pending >= LOG_GROUP_NS) && commit_group(log) != 0)
+    {
+        log->used -= sizeof(record) + record.name_length;
+        log->pending--;
+        pthread_mutex_unlock(&log->lock);
+        return -1;
+    }
+    
+    pthread_mutex_unlock(&log->lock);
+    return 0;
+}
+
+/* The function commits the current group of the log.
+ * It returns 0 on success (always without a log or without records), -1 on error */
+int log_commit(struct data_set *data)
+{
+    struct write_ahead_log *log = data->log;
+    int                    result;
+    
+    if (log == NULL)
+    {
+        return 0;
+    }
+    
+    pthread_mutex_lock(&log->lock);
+    result = commit_group(log);
+    pthread_mutex_unlock(&log->lock);
+    
+    return result;
+}
+
+/* Timer thread of the log: it sleeps until the current group is LOG_GROUP_NS old and commits it, so records don't
+ * wait for the next append when the commands are slow to come. A failed commit is retried after the same time */
+void *log_timer(void *argument)
+{
+    struct write_ahead_log *log = (struct write_ahead_log *) argument;
+    
+    pthread_mutex_lock(&log->lock);
+    while (!log->closing)
+    {
+        if (log->pending == 0)
+        {
+            pthread_cond_wait(&log->wake,
+                              &log->lock);
+            continue;
+        }
+        
+        long long deadline = log->first_pending + LOG_GROUP_NS;
+        if (now_ns() >= deadline && commit_group(log) != 0)
+        {
+            deadline = now_ns() + LOG_GROUP_NS;
+        }
+        if (log->pending > 0)
+        {
+            struct timespec until = { deadline / 1000000000LL, deadline % 1000000000LL };
+            pthread_cond_timedwait(&log->wake,
+                                   &log->lock,
+                                   &until);
+        }
+    }
+    pthread_mutex_unlock(&log->lock);
+    
+    return NULL;
+}
+
+/* The function compacts the log when it is large enough. It must be called where every index is up to date.
+ * Without a snapshot file the log can't shrink, so nothing is done; after a failed compaction the next one
+ * waits for the log to grow by LOG_COMPACT_BYTES again.
+ * It returns 0 on success (always without a log), -1 on error */
+int log_checkpoint(struct data_set *data)
+{
+    struct write_ahead_log *log = data->log;
+    
+    if (log == NULL || log->snapshot_file == NULL)
+    {
+        return 0;
+    }
+    
+    pthread_mutex_lock(&log->lock);
+    off_t length = log->size + (off_t) log->used;
+    pthread_mutex_unlock(&log->lock);
+    if (length < log->compact_size)
+    {
+        return 0;
+    }
+    
+    if (log_compact(data) < 0)
+    {
+        log->compact_size = length + LOG_COMPACT_BYTES;
+        return -1;
+    }
+    log->compact_size = LOG_COMPACT_BYTES;
+    
+    return 0;
+}
+
+/* The function commits the log, saves the data set in the snapshot and empties the log, since the snapshot holds
+ * every recorded operation. A crash before the log is emptied only replays operations the snapshot already holds.
+ * Without a snapshot file the log is only committed.
+ * It returns the number of saved articles, 0 without a snapshot file, -1 on error */
+int log_compact(struct data_set *data)
+{
+    struct write_ahead_log *log = data->log;
+    int                    saved;
+    
+    if (log_commit(data) != 0)
+    {
+        return -1;
+    }
+    if (log == NULL || log->snapshot_file == NULL)
+    {
+        return 0;
+    }
+    
+    saved = save_snapshot(data,
+                          log->snapshot_file);
+    if (saved < 0)
+    {
+        return -1;
+    }
+    pthread_mutex_lock(&log->lock);
+    if (ftruncate(log->descriptor,
+                  sizeof(struct log_header)) != 0 || fsync(log->descriptor) != 0)
+    {
+        pthread_mutex_unlock(&log->lock);
+        fprintf(stderr,
+                "[WARNING] %s: %s\n",
+                log->file,
+                strerror(errno));
+        return -1;
+    }
+    log->size = sizeof(struct log_header);
+    pthread_mutex_unlock(&log->lock);
+    
+    return saved;
+}
+
+/* The function stops the timer, closes the log file and frees the group buffer, records not committed yet are lost */
+void log_close(struct write_ahead_log *log)
+{
+    if (log->timer_started)
+    {
+        pthread_mutex_lock(&log->lock);
+        log->closing = 1;
+        pthread_cond_signal(&log->wake);
+        pthread_mutex_unlock(&log->lock);
+        pthread_join(log->timer,
+                     NULL);
+        log->timer_started = 0;
+    }
+    pthread_mutex_destroy(&log->lock);
+    pthread_cond_destroy(&log->wake);
+    if (log->descriptor >= 0)
+    {
+        close(log->descriptor);
+    }
+    free(log->buffer);
+    log->descriptor = -1;
+    log->buffer     = NULL;
+}
+
+/* The function continues the CRC-32 (the one of zip and PNG) crc, which is 0 at the start, over the given bytes.
+ * It goes 8 bytes at a time (slicing by 8): table[k] holds the remainders of the 256 byte values followed by k zero
+ * bytes, so the 8 lookups of a step are independent. The tables are computed on the first call */
+uint32_t crc32(uint32_t crc,
+               const void *bytes,
+               size_t length)
+{
+    static uint32_t     table[8][256];
+    const unsigned char *byte = (const unsigned char *) bytes;
+    size_t              i;
+    
+    if (table[0][1] == 0)
+    {
+        for (i = 0; i < 256; i++)
+        {
+            uint32_t remainder = (uint32_t) i;
+            int      bit;
+            for (bit = 0; bit < 8; bit++)
+            {
+                remainder = remainder & 1 ? 0xEDB88320u ^ remainder >> 1 : remainder >> 1;
+            }
+            table[0][i] = remainder;
+        }
+        for (i = 0; i < 256; i++)
+        {
+            int k;
+            for (k = 1; k < 8; k++)
+            {
+                table[k][i] = table[0][table[k - 1][i] & 0xFF] ^ table[k - 1][i] >> 8;
+            }
+        }
+    }
+    
+    crc = ~crc;
+    for (; length >= 8; length -= 8, byte += 8)
+    {
+        crc ^= (uint32_t) byte[0] | (uint32_t) byte[1] << 8 | (uint32_t) byte[2] << 16 | (uint32_t) byte[3] << 24;
+        crc = table[7][crc & 0xFF] ^ table[6][crc >> 8 & 0xFF] ^ table[5][crc >> 16 & 0xFF] ^ table[4][crc >> 24] ^
+              table[3][byte[4]] ^ table[2][byte[5]] ^ table[1][byte[6]] ^ table[0][byte[7]];
+    }
+    for (i = 0; i < length; i++)
+    {
+        crc = table[0][(crc ^ byte[i]) & 0xFF] ^ crc >> 8;
+    }
+    
+    return ~crc;
+}
+
+
+/* Shared index functions */
+
+/* The function initializes the shared indexes with a first version holding two empty trees.
+ * Articles removed later are given back to the given pool, unless it is NULL.
+ * It returns 0 on success, -1 if memory allocation fails */
+int shared_init(struct shared_index *index,
+                struct memory_pool *articles)
+{
+    struct index_version *version;
+    int                  i;
+    
+    for (i = 0; i < SHARED_MAX_READERS; i++)
+    {
+        atomic_init(&index->readers[i].epoch,
+                    0);
+    }
+    atomic_init(&index->epoch,
+                1);
+    pthread_mutex_init(&index->writer,
+                       NULL);
+    pool_init(&index->nodes,
+              sizeof(struct node));
+    pool_init(&index->versions,
+              sizeof(struct index_version));
+    index->articles         = articles;
+    index->retired          = NULL;
+    index->retired_count    = 0;
+    index->retired_capacity = 0;
+    index->fresh_count      = 0;
+    
+    version = (struct index_version *) pool_alloc(&index->versions);
+    atomic_init(&index->version,
+                version);
+    if (version == NULL)
+    {
+        return -1;
+    }
+    version->root_product_id   = NULL;
+    version->root_process_time = NULL;
+    version->count             = 0;
+    
+    return 0;
+}
+
+/* The function replaces both trees of the shared indexes with the ones built from the articles sorted by product id
+ * and by process time, in O(n), and publishes them. Unless the trees were empty, the new ones are built in a new pool
+ * of nodes and the old pool is retired as a whole, with the given removed articles: readers still in the old version
+ * keep using it, and no node is retired one by one.
+ * It returns 0 on success, -1 if memory allocation fails (the current version stays) */
+int shared_build(struct shared_index *index,
+                 struct article **by_product_id,
+                 struct article **by_process_time,
+                 int count,
+                 struct article **removed,
+                 int removed_count)
+{
+    pthread_mutex_lock(&index->writer);
+    if (index->retired_count >= SHARED_RETIRE_BATCH)
+    {
+        shared_reclaim(index);
+    }
+    
+    struct index_version *old       = atomic_load(&index->version);
+    struct index_version *version   = (struct index_version *) pool_alloc(&index->versions);
+    struct memory_pool   *old_nodes = NULL;
+    int                  result     = version == NULL ? -1 : 0;
+    int                  i, j;
+    
+    if (result == 0 && (old->root_product_id != NULL || old->root_process_time != NULL))
+    {
+        old_nodes = (struct memory_pool *) malloc(sizeof(struct memory_pool));
+        if (old_nodes == NULL)
+        {
+            printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+            result = -1;
+        }
+        else
+        {
+            *old_nodes = index->nodes;
+            pool_init(&index->nodes,
+                      sizeof(struct node));
+        }
+    }
+    if (result == 0)
+    {
+        version->root_product_id   = build_tree(&index->nodes,
+                                                by_product_id,
+                                                count);
+        version->root_process_time = build_tree(&index->nodes,
+                                                by_process_time,
+                                                count);
+        version->count             = count;
+        if (count > 0 && (version->root_product_id == NULL || version->root_process_time == NULL))
+        {
+            result = -1;
+        }
+    }
+    
+    /* Nodes retired one by one are in the old pool, they are freed with it */
+    if (result == 0 && old_nodes != NULL)
+    {
+        for (i = 0, j = 0; i < index->retired_count; i++)
+        {
+            if (index->retired[i].kind != RETIRED_NODE)
+            {
+                index->retired[j++] = index->retired[i];
+            }
+        }
+        index->retired_count = j;
+    }
+    
+    int first_retired = index->retired_count;
+    if (result == 0 && old_nodes != NULL)
+    {
+        result = retire(index,
+                        old_nodes,
+                        RETIRED_POOL);
+    }
+    for (i = 0; i < removed_count && result == 0; i++)
+    {
+        result = retire(index,
+                        removed[i],
+                        RETIRED_ARTICLE);
+    }
+    if (result != 0 && old_nodes != NULL)
+    {
+        pool_destroy(&index->nodes);
+        index->nodes = *old_nodes;
+        free(old_nodes);
+    }
+    result = shared_publish(index,
+                            old,
+                            version,
+                            first_retired,
+                            result);
+    
+    pthread_mutex_unlock(&index->writer);
+    
+    return result;
+}
+
+/* The function enters the reader in the current epoch and returns the current version of the shared indexes.
+ * Nothing the version reaches is freed before the reader exits, whatever the writer does meanwhile.
+ * Every reader thread has its own slot, from 0 to SHARED_MAX_READERS - 1 */
+struct index_version *reader_enter(struct shared_index *index,
+                                   int reader)
+{
+    atomic_store(&index->readers[reader].epoch,
+                 atomic_load(&index->epoch));
+    
+    return atomic_load(&index->version);
+}
+
+/* The function takes the reader out of its epoch, the version it entered with must not be used anymore */
+void reader_exit(struct shared_index *index,
+                 int reader)
+{
+    atomic_store(&index->readers[reader].epoch,
+                 0);
+}
+
+/* The function inserts the article in both trees of the shared indexes and publishes the new version.
+ * Only the nodes on the paths from the roots to the article are copied, readers keep using the old version.
+ * It returns 0 on success, 1 if the product id is already there, -1 if memory allocation fails */
+int shared_insert(struct shared_index *index,
+                  struct article *item)
+{
+    pthread_mutex_lock(&index->writer);
+    if (index->retired_count >= SHARED_RETIRE_BATCH)
+    {
+        shared_reclaim(index);
+    }
+    
+    struct index_version *old          = atomic_load(&index->version);
+    struct index_version *version      = NULL;
+    int                  first_retired = index->retired_count;
+    int                  result        = 1;
+    
+    if (search_id(old->root_product_id,
+                  item->product_id) == NULL)
+    {
+        version = (struct index_version *) pool_alloc(&index->versions);
+        result  = -1;
+        if (version != NULL)
+        {
+            *version = *old;
+            version->count++;
+            result = copy_insert(index,
+                                 &version->root_product_id,
+                                 item,
+                                 TYPE_PRODUCT_ID) != 0 || copy_insert(index,
+                                                                      &version->root_process_time,
+                                                                      item,
+                                                                      TYPE_PROCESS_TIME) != 0 ? -1 : 0;
+        }
+    }
+    result = shared_publish(index,
+                            old,
+                            version,
+                            first_retired,
+                            result);
+    
+    pthread_mutex_unlock(&index->writer);
+    
+    return result;
+}
+
+/* The function removes the article of the product id from both trees of the shared indexes and publishes
+ * the new version. The article is given back to its pool when no reader can reach it anymore, and never before
+ * the next change: until then the writer can still use it.
+ * It returns 0 on success, 1 if the product id is not there, -1 if memory allocation fails */
+int shared_remove(struct shared_index *index,
+                  uint32_t product_id)
+{
+    pthread_mutex_lock(&index->writer);
+    if (index->retired_count >= SHARED_RETIRE_BATCH)
+    {
+        shared_reclaim(index);
+    }
+    
+    struct index_version *old          = atomic_load(&index->version);
+    struct index_version *version      = NULL;
+    struct node          *found        = search_id(old->root_product_id,
+                                                   product_id);
+    int                  first_retired = index->retired_count;
+    int                  result        = 1;
+    
+    if (found != NULL)
+    {
+        struct article *item = found->item;
+        
+        version = (struct index_version *) pool_alloc(&index->versions);
+        result  = -1;
+        if (version != NULL)
+        {
+            *version = *old;
+            version->count--;
+            result = copy_remove(index,
+                                 &version->root_product_id,
+                                 item,
+                                 TYPE_PRODUCT_ID) != 0 || copy_remove(index,
+                                                                      &version->root_process_time,
+                                                                      item,
+                                                                      TYPE_PROCESS_TIME) != 0 ||
+                     retire(index,
+                            item,
+                            RETIRED_ARTICLE) != 0 ? -1 : 0;
+        }
+    }
+    result = shared_publish(index,
+                            old,
+                            version,
+                            first_retired,
+                            result);
+    
+    pthread_mutex_unlock(&index->writer);
+    
+    return result;
+}
+
+/* The function ends a change of the writer. On success the new version replaces the old one, the objects retired
+ * by the change get the epoch of the old version and the epoch moves on: a reader entering from now on
+ * can't reach them. Otherwise the new version is dropped and the objects are not retired anymore.
+ * It returns the result of the change */
+static int shared_publish(struct shared_index *index,
+                          struct index_version *old,
+                          struct index_version *version,
+                          int first_retired,
+                          int result)
+{
+    if (result == 0 && retire(index,
+                              old,
+                              RETIRED_VERSION) != 0)
+    {
+        result = -1;
+    }
+    if (result != 0)
+    {
+        /* Nodes copied by a failed change stay in the pool until the shared indexes are freed */
+        index->retired_count = first_retired;
+        if (version != NULL)
+        {
+            pool_release(&index->versions,
+                         version);
+        }
+        return result;
+    }
+    
+    atomic_store(&index->version,
+                 version);
+    
+    uint64_t epoch = atomic_load(&index->epoch);
+    int      i;
+    for (i = first_retired; i < index->retired_count; i++)
+    {
+        index->retired[i].epoch = epoch;
+    }
+    atomic_store(&index->epoch,
+                 epoch + 1);
+    
+    return 0;
+}
+
+/* The function frees the retired objects that no reader can reach anymore: the ones retired before the epoch
+ * of the oldest reader still inside. It is called by the writer at the start of a change */
+void shared_reclaim(struct shared_index *index)
+{
+    uint64_t oldest = UINT64_MAX;
+    int      i, j;
+    
+    for (i = 0; i < SHARED_MAX_READERS; i++)
+    {
+        uint64_t epoch = atomic_load(&index->readers[i].epoch);
+        if (epoch != 0 && epoch < oldest)
+        {
+            oldest = epoch;
+        }
+    }
+    
+    for (i = 0, j = 0; i < index->retired_count; i++)
+    {
+        struct retired_object *retired = &index->retired[i];
+        if (retired->epoch >= oldest)
+        {
+            index->retired[j++] = *retired;
+        }
+        else if (retired->kind == RETIRED_NODE)
+        {
+            pool_release(&index->nodes,
+                         retired->object);
+        }
+        else if (retired->kind == RETIRED_ARTICLE)
+        {
+            if (index->articles != NULL)
+            {
+                pool_release(index->articles,
+                             retired->object);
+            }
+        }
+        else if (retired->kind == RETIRED_VERSION)
+        {
+            pool_release(&index->versions,
+                         retired->object);
+        }
+        else
+        {
+            pool_destroy((struct memory_pool *) retired->object);
+            free(retired->object);
+        }
+    }
+    index->retired_count = j;
+}
+
+/* The function frees the shared indexes, no reader can be inside. The articles still in the trees are not freed */
+void shared_free(struct shared_index *index)
+{
+    int i;
+    
+    for (i = 0; i < index->retired_count; i++)
+    {
+        if (index->retired[i].kind == RETIRED_ARTICLE && index->articles != NULL)
+        {
+            pool_release(index->articles,
+                         index->retired[i].object);
+        }
+        else if (index->retired[i].kind == RETIRED_POOL)
+        {
+            pool_destroy((struct memory_pool *) index->retired[i].object);
+            free(index->retired[i].object);
+        }
+    }
+    free(index->retired);
+    pool_destroy(&index->nodes);
+    pool_destroy(&index->versions);
+    pthread_mutex_destroy(&index->writer);
+    
+    index->retired       = NULL;
+    index->retired_count = 0;
+    atomic_store(&index->version,
+                 NULL);
+}
+
+/* The function adds an object unlinked by the current change of the writer to the retired ones.
+ * It returns 0 on success, -1 if memory allocation fails */
+static int retire(struct shared_index *index,
+                  void *object,
+                  int kind)
+{
+    if (index->retired_count == index->retired_capacity)
+    {
+        int                   capacity = index->retired_capacity == 0 ? SHARED_RETIRE_BATCH * 2 :
+                                         index->retired_capacity * 2;
+        struct retired_object *grown   = (struct retired_object *) realloc(index->retired,
+                                                                            capacity * sizeof(struct retired_object));
+        if (grown == NULL)
+        {
+            printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+            return -1;
+        }
+        index->retired          = grown;
+        index->retired_capacity = capacity;
+    }
+    
+    index->retired[index->retired_count].object = object;
+    index->retired[index->retired_count].epoch  = 0;
+    index->retired[index->retired_count].kind   = kind;
+    index->retired_count++;
+    
+    return 0;
+}
+
+/* The function copies a node of the current version, so the copy can be changed, and retires the node.
+ * A node made by the current tree change is not published yet, so it is changed in place instead.
+ * It returns the copy (or the node itself), NULL if memory allocation fails */
+static struct node *copy_node(struct shared_index *index,
+                              struct node *node)
+{
+    int i;
+    
+    for (i = 0; i < index->fresh_count; i++)
+    {
+        if (index->fresh[i] == node)
+        {
+            return node;
+        }
+    }
+    
+    struct node *copy = (struct node *) pool_alloc(&index->nodes);
+    if (copy == NULL || retire(index,
+                               node,
+                               RETIRED_NODE) != 0)
+    {
+        return NULL;
+    }
+    *copy = *node;
+    index->fresh[index->fresh_count++] = copy;
+    
+    return copy;
+}
+
+/* The function rebalances a copied node as balance() does, but first it copies the children the rotations change,
+ * since they may be shared with the current version. It returns the new root of the subtree, NULL if memory
+ * allocation fails */
+static struct node *copy_balance(struct shared_index *index,
+                                 struct node *node)
+{
+    int balance_factor = node_height(node->left) - node_height(node->right);
+    
+    if (balance_factor > 1)
+    {
+        if ((node->left = copy_node(index,
+                                    node->left)) == NULL)
+        {
+            return NULL;
+        }
+        if (node_height(node->left->left) < node_height(node->left->right) &&
+            (node->left->right = copy_node(index,
+                                           node->left->right)) == NULL)
+        {
+            return NULL;
+        }
+    }
+    else if (balance_factor < -1)
+    {
+        if ((node->right = copy_node(index,
+                                     node->right)) == NULL)
+        {
+            return NULL;
+        }
+        if (node_height(node->right->right) < node_height(node->right->left) &&
+            (node->right->left = copy_node(index,
+                                           node->right->left)) == NULL)
+        {
+            return NULL;
+        }
+    }
+    
+    return balance(node);
+}
+
+/* The function inserts the item in the tree of the given root, of the given type, without changing any node of it:
+ * the nodes on the path to the item are copied from the bottom up, and the root is replaced by its copy.
+ * It returns 0 on success, -1 if memory allocation fails */
+static int copy_insert(struct shared_index *index,
+                       struct node **root,
+                       struct article *item,
+                       int type)
+{
+    struct node *path[MAX_TREE_HEIGHT];
+    int         went_left[MAX_TREE_HEIGHT];
+    int         depth = 0;
+    struct node *node = *root;
+    struct node *child;
+    
+    STAT_BEGIN(STAT_TREE_INSERT);
+    while (node != NULL)
+    {
+        path[depth]      = node;
+        went_left[depth] = compare_items(item,
+                                         node->item,
+                                         type) < 0;
+        node = went_left[depth++] ? node->left : node->right;
+    }
+    
+    child              = new_node(&index->nodes,
+                                  item);
+    index->fresh[0]    = child;
+    index->fresh_count = 1;
+    while (child != NULL && depth > 0)
+    {
+        struct node *copy = copy_node(index,
+                                      path[--depth]);
+        if (copy == NULL)
+        {
+            STAT_END();
+            return -1;
+        }
+        if (went_left[depth])
+        {
+            copy->left = child;
+        }
+        else
+        {
+            copy->right = child;
+        }
+        child = copy_balance(index,
+                             copy);
+    }
+    
+    STAT_END();
+    if (child == NULL)
+    {
+        return -1;
+    }
+    *root = child;
+    
+    return 0;
+}
+
+/* The function removes the item from the tree of the given root, of the given type, without changing any node of it.
+ * A node with two children takes the item of its successor, whose node is removed instead; the nodes on the path
+ * to the removed node are copied from the bottom up. It returns 0 on success, -1 if memory allocation fails */
+static int copy_remove(struct shared_index *index,
+                       struct node **root,
+                       struct article *item,
+                       int type)
+{
+    struct node *path[MAX_TREE_HEIGHT];
+    int         went_left[MAX_TREE_HEIGHT];
+    int         depth  = 0, target = -1, result;
+    struct node *node  = *root;
+    struct node *child;
+    
+    STAT_BEGIN(STAT_TREE_REMOVE);
+    while (node != NULL && (result = compare_items(item,
+                                                   node->item,
+                                                   type)) != 0)
+    {
+        path[depth]      = node;
+        went_left[depth] = result < 0;
+        node = went_left[depth++] ? node->left : node->right;
+    }
+    if (node == NULL)
+    {
+        STAT_END();
+        return 0;
+    }
+    
+    if (node->left != NULL && node->right != NULL)
+    {
+        target           = depth;
+        path[depth]      = node;
+        went_left[depth] = 0;
+        depth++;
+        node = node->right;
+        while (node->left != NULL)
+        {
+            path[depth]      = node;
+            went_left[depth] = 1;
+            depth++;
+            node = node->left;
+        }
+    }
+    
+    struct article *successor = node->item;
+    child              = node->left != NULL ? node->left : node->right;
+    index->fresh_count = 0;
+    if (retire(index,
+               node,
+               RETIRED_NODE) != 0)
+    {
+        STAT_END();
+        return -1;
+    }
+    
+    while (depth > 0)
+    {
+        struct node *copy = copy_node(index,
+                                      path[--depth]);
+        if (copy == NULL)
+        {
+            STAT_END();
+            return -1;
+        }
+        if (went_left[depth])
+        {
+            copy->left = child;
+        }
+        else
+        {
+            copy->right = child;
+        }
+        if (depth == target)
+        {
+            copy->item = successor;
+        }
+        if ((child = copy_balance(index,
+                                  copy)) == NULL)
+        {
+            STAT_END();
+            return -1;
+        }
+    }
+    *root = child;
+    
+    STAT_END();
+    return 0;
+}
+
+/* Binary tree functions */
+
+/* The function acquires the item and allocates a new node with the given data.
+It also initialize the node left and right pointers as NULL. Then, the node is returned. */
+struct node *new_node(struct memory_pool *pool,
+                      struct article *item)
+{
+    struct node *temp = (struct node *) pool_alloc(pool); /* Allocate memory for new node from the nodes pool */
+    
+    if (temp != NULL)
+    {
+        temp->item = item; /* Storing the item in the node */
+        temp->left = temp->right = NULL; /* Initialize left and right child as NULL */
+        temp->height = 1; /* A new node is always a leaf */
+        temp->size   = 1;
+    }
+    else
+    {
+        printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+    }
+    
+    return temp;
+}
+
+/* The function acquires two items and the type of data to compare.
+   It returns a negative value if a comes before b, a positive value if a comes after b, 0 if they are the same key.
+   Process time allows duplicate values, so the product id (which is unique) is used to break ties:
+   this way both trees have a strict ordering, which is required to keep them balanced with rotations. */
+int compare_items(struct article *a,
+                  struct article *b,
+                  int type)
+{
+    int result = 0;
+    
+    STAT_COUNT(comparisons,
+               1);
+    switch (type)
+    {
+        case TYPE_PRODUCT_ID:
+            result = (a->product_id > b->product_id) - (a->product_id < b->product_id);
+            break;
+        
+        case TYPE_PROCESS_TIME:
+            if (a->process_time < b->process_time)
+            {
+                result = -1;
+            }
+            else if (a->process_time > b->process_time)
+            {
+                result = 1;
+            }
+            else
+            {
+                result = (a->product_id > b->product_id) - (a->product_id < b->product_id);
+            }
+            break;
+        
+        default:
+            break;
+    }
+    
+    return result;
+}
+
+/* The function returns the height of a node, 0 for an empty tree */
+int node_height(struct node *node)
+{
+    return node == NULL ? 0 : node->height;
+}
+
+/* The function recalculates the height and the size of a node from its children */
+void update_height(struct node *node)
+{
+    int left_height  = node_height(node->left);
+    int right_height = node_height(node->right);
+    
+    node->height = 1 + (left_height > right_height ? left_height : right_height);
+    node->size   = 1 + node_size(node->left) + node_size(node->right);
+}
+
+/* The function rotates the given node to the left and returns the new root of the subtree */
+struct node *rotate_left(struct node *node)
+{
+    struct node *pivot = node->right;
+    
+    node->right = pivot->left;
+    pivot->left = node;
+    
+    update_height(node);
+    update_height(pivot);
+    
+    return pivot;
+}
+
+/* The function rotates the given node to the right and returns the new root of the subtree */
+struct node *rotate_right(struct node *node)
+{
+    struct node *pivot = node->left;
+    
+    node->left   = pivot->right;
+    pivot->right = node;
+    
+    update_height(node);
+    update_height(pivot);
+    
+    return pivot;
+}
+
+/* The function acquires a node whose children are balanced, and whose heights differ at most by 2.
+   Then it restores the AVL property with one or two rotations and returns the new root of the subtree. */
+struct node *balance(struct node *node)
+{
+    update_height(node);
+    
+    int balance_factor = node_height(node->left) - node_height(node->right);
+    
+    /* Left subtree is too high */
+    if (balance_factor > 1)
+    {
+        /* Left-right case: the left child must be rotated first */
+        if (node_height(node->left->left) < node_height(node->left->right))
+        {
+            node->left = rotate_left(node->left);
+        }
+        node = rotate_right(node);
+    }
+        /* Right subtree is too high */
+    else if (balance_factor < -1)
+    {
+        /* Right-left case: the right child must be rotated first */
+        if (node_height(node->right->right) < node_height(node->right->left))
+        {
+            node->right = rotate_right(node->right);
+        }
+        node = rotate_left(node);
+    }
+    
+    return node;
+}
+
+/* The function acquires the root of the product id tree and the product_id of the searched element.
+   Since the tree is ordered by product id, the search descends only one path from the root to a leaf.
+   It returns the node if the element exists, NULL otherwise */
+struct node *search_id(struct node *root,
+                       uint32_t id)
+{
+    struct node *current = root;
+    
+    STAT_BEGIN(STAT_TREE_SEARCH);
+    while (current != NULL)
+    {
+        STAT_COUNT(visits,
+                   1);
+        STAT_COUNT(comparisons,
+                   1);
+        if (id == current->item->product_id)
+        {
+            STAT_END();
+            return current;
+        }
+        current = id < current->item->product_id ? current->left : current->right;
+    }
+    
+    /* search didn't find anything */
+    STAT_END();
+    return NULL;
+}
+
+/* The function acquires an array of articles sorted by the tree key, and builds a perfectly balanced tree from it in O(n):
+   the middle article is the root, the two halves are its subtrees. It returns the root, NULL if memory allocation fails */
+struct node *build_tree(struct memory_pool *pool,
+                        struct article **items,
+                        int count)
+{
+    struct node *root = NULL;
+    
+    if (count > 0)
+    {
+        int middle = count / 2;
+        
+        root = new_node(pool,
+                        items[middle]);
+        if (root != NULL)
+        {
+            root->left  = build_tree(pool,
+                                     items,
+                                     middle);
+            root->right = build_tree(pool,
+                                     items + middle + 1,
+                                     count - middle - 1);
+            update_height(root);
+        }
+    }
+    
+    return root;
+}
+
+/* The function acquires an array of articles and sorts it by the key of the given type with a stable LSD radix sort,
+ * one byte per pass: 4 passes on the product id, or on the process time (with the sign bit flipped, so negative values
+ * come first). Passes where every key has the same byte are skipped. To sort by process time and product id, sort by
+ * product id first. It returns 0 on success, -1 if memory allocation fails */
+int sort_articles(struct article **items,
+                  int count,
+                  int type)
+{
+    struct article **scratch = (struct article **) malloc((count + 1) * sizeof(struct article *));
+    struct article **from    = items;
+    struct article **to      = scratch;
+    int            shift, i;
+    
+    if (scratch == NULL)
+    {
+        printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+        return -1;
+    }
+    
+    for (shift = 0; shift < 32; shift += 8)
+    {
+        int buckets[256] = {0};
+        
+#define SORT_KEY(item) (type == TYPE_PRODUCT_ID ? (item)->product_id : (uint32_t) (item)->process_time ^ 0x80000000u)
+        for (i = 0; i < count; i++)
+        {
+            buckets[SORT_KEY(from[i]) >> shift & 0xFF]++;
+        }
+        if (count == 0 || buckets[SORT_KEY(from[0]) >> shift & 0xFF] == count)
+        {
+            continue;
+        }
+        
+        /* Turning the counts into the first position of every bucket, then distributing */
+        int position = 0;
+        for (i = 0; i < 256; i++)
+        {
+            int bucket = buckets[i];
+            buckets[i] = position;
+            position += bucket;
+        }
+        for (i = 0; i < count; i++)
+        {
+            to[buckets[SORT_KEY(from[i]) >> shift & 0xFF]++] = from[i];
+        }
+#undef SORT_KEY
+        
+        struct article **temp = from;
+        from = to;
+        to   = temp;
+    }
+    
+    if (from != items)
+    {
+        memcpy(items,
+               from,
+               count * sizeof(struct article *));
+    }
+    free(scratch);
+    
+    return 0;
+}
+
+/* The function acquires the root and print its data in order */
+void print_tree(struct node *root)
+{
+    struct tree_cursor cursor;
+    
+    for (cursor_first(&cursor,
+                      root); cursor.depth > 0; cursor_next(&cursor))
+    {
+        print_article(cursor_item(&cursor));
+    }
+}
+
+/* The function returns the number of nodes of a subtree, 0 for an empty tree */
+int node_size(struct node *node)
+{
+    return node == NULL ? 0 : node->size;
+}
+
+/* The function acquires the root of a tree and a rank (0 is the first item in order), and returns the node
+ * with that rank descending a single path with the subtree sizes. It returns NULL if the rank is out of range */
+struct node *select_node(struct node *root,
+                         int rank)
+{
+    struct node *current = root;
+    
+    while (current != NULL)
+    {
+        int left_size = node_size(current->left);
+        
+        if (rank < left_size)
+        {
+            current = current->left;
+        }
+        else if (rank > left_size)
+        {
+            rank -= left_size + 1;
+            current = current->right;
+        }
+        else
+        {
+            break;
+        }
+    }
+    
+    return current;
+}
+
+/* The function acquires the root of a tree, an item and the type of the tree,
+ * and returns the number of items of the tree that come before the given one, in O(log n) */
+int rank_of(struct node *root,
+            struct article *item,
+            int type)
+{
+    struct node *current = root;
+    int         rank     = 0;
+    
+    while (current != NULL)
+    {
+        int result = compare_items(item,
+                                   current->item,
+                                   type);
+        if (result <= 0)
+        {
+            if (result == 0)
+            {
+                return rank + node_size(current->left);
+            }
+            current = current->left;
+        }
+        else
+        {
+            rank += node_size(current->left) + 1;
+            current = current->right;
+        }
+    }
+    
+    return rank;
+}
+
+/* The function returns the nearest rank (from 1 to count) of a fraction between 0 and 1 of count items: the smallest
+ * rank that covers the fraction. The fraction is rounded to millionths and the ceiling is taken in integers,
+ * since a product like 0.57 * 100 is not exact in floating point */
+long nearest_rank(double fraction,
+                  long count)
+{
+    long long millionths = (long long) (fraction * 1000000 + 0.5);
+    long long rank       = (millionths * count + 999999) / 1000000;
+    
+    if (millionths < 0 || rank < 1)
+    {
+        return 1;
+    }
+    
+    return rank > count ? count : (long) rank;
+}
+
+/* The function acquires the root of a tree and a fraction between 0 and 1, and returns the item at that percentile
+ * with the nearest-rank method (0 is the first item, 1 the last one). It returns NULL for an empty tree */
+struct article *percentile(struct node *root,
+                           double fraction)
+{
+    int count = node_size(root);
+    
+    if (count == 0)
+    {
+        return NULL;
+    }
+    
+    return select_node(root,
+                       (int) nearest_rank(fraction,
+                                          count) - 1)->item;
+}
+
+/* The function acquires the root of the process time tree and prints in order the items whose process time
+ * is between low and high (both included). The cursor starts from the first item not lower than low,
+ * so it costs O(log n + k). It returns the number of printed items */
+int print_range(struct node *root,
+                int32_t low,
+                int32_t high)
+{
+    struct tree_cursor cursor;
+    struct article     key;
+    int                count = 0;
+    
+    key.process_time = low;
+    key.product_id   = 0;
+    
+    for (cursor_seek(&cursor,
+                     root,
+                     &key,
+                     TYPE_PROCESS_TIME); cursor.depth > 0 && cursor_item(&cursor)->process_time <= high; cursor_next(&cursor))
+    {
+        print_article(cursor_item(&cursor));
+        count++;
+    }
+    
+    return count;
+}
+/* The function acquires the root of the process time tree and prints the remaining number of items
+ * from the slowest one backwards, stopping as soon as enough items are printed */
+void print_slowest(struct node *root,
+                   int *remaining)
+{
+    struct tree_cursor cursor;
+    
+    for (cursor_last(&cursor,
+                     root); cursor.depth > 0 && *remaining > 0; cursor_prev(&cursor))
+    {
+        print_article(cursor_item(&cursor));
+        (*remaining)--;
+    }
+}
+
+/* The function places the cursor on the first item of the tree, past the end if the tree is empty */
+void cursor_first(struct tree_cursor *cursor,
+                  struct node *root)
+{
+    cursor->depth = 0;
+    for (; root != NULL; root = root->left)
+    {
+        cursor->path[cursor->depth++] = root;
+    }
+}
+
+/* The function places the cursor on the last item of the tree, past the end if the tree is empty */
+void cursor_last(struct tree_cursor *cursor,
+                 struct node *root)
+{
+    cursor->depth = 0;
+    for (; root != NULL; root = root->right)
+    {
+        cursor->path[cursor->depth++] = root;
+    }
+}
+
+/* The function places the cursor on the first item of the tree not lower than the given key, in O(log n).
+ * The cursor is past the end if every item is lower than the key */
+void cursor_seek(struct tree_cursor *cursor,
+                 struct node *root,
+                 struct article *key,
+                 int type)
+{
+    int found = 0;
+    
+    /* The path is followed down to a leaf; the cursor is then cut back to the last node not lower than the key */
+    cursor->depth = 0;
+    while (root != NULL)
+    {
+        int result = compare_items(key,
+                                   root->item,
+                                   type);
+        
+        cursor->path[cursor->depth++] = root;
+        if (result <= 0)
+        {
+            found = cursor->depth;
+            if (result == 0)
+            {
+                break;
+            }
+            root = root->left;
+        }
+        else
+        {
+            root = root->right;
+        }
+    }
+    
+    cursor->depth = found;
+}
+
+/* The function returns the item under the cursor, NULL if the cursor is past the end */
+struct article *cursor_item(struct tree_cursor *cursor)
+{
+    return cursor->depth > 0 ? cursor->path[cursor->depth - 1]->item : NULL;
+}
+
+/* The function moves the cursor to the next item in order: the smallest one of the right subtree if there is one,
+ * otherwise the first ancestor reached from its left subtree */
+void cursor_next(struct tree_cursor *cursor)
+{
+    struct node *node = cursor->path[cursor->depth - 1];
+    
+    if (node->right != NULL)
+    {
+        for (node = node->right; node != NULL; node = node->left)
+        {
+            cursor->path[cursor->depth++] = node;
+        }
+        return;
+    }
+    
+    while (--cursor->depth > 0 && cursor->path[cursor->depth - 1]->right == node)
+    {
+        node = cursor->path[cursor->depth - 1];
+    }
+}
+
+/* The function moves the cursor to the previous item in order, mirroring cursor_next() */
+void cursor_prev(struct tree_cursor *cursor)
+{
+    struct node *node = cursor->path[cursor->depth - 1];
+    
+    if (node->left != NULL)
+    {
+        for (node = node->left; node != NULL; node = node->right)
+        {
+            cursor->path[cursor->depth++] = node;
+        }
+        return;
+    }
+    
+    while (--cursor->depth > 0 && cursor->path[cursor->depth - 1]->left == node)
+    {
+        node = cursor->path[cursor->depth - 1];
+    }
+}
+
+/* List functions */
+
+/* The function initializes an empty sorted list ordered by the key of the given type */
+void list_init(struct sorted_list *list,
+               int type)
+{
+    list->chunks         = NULL;
+    list->chunk_count    = 0;
+    list->chunk_capacity = 0;
+    list->count          = 0;
+    list->type           = type;
+}
+
+/* The function returns the position of the first article of the chunk not lower than the given article */
+static int chunk_lower_bound(struct list_chunk *chunk,
+                             struct article *item,
+                             int type)
+{
+    int low = 0, high = chunk->count;
+    
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (compare_items(chunk->items[middle],
+                          item,
+                          type) < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    
+    return low;
+}
+
+/* The function returns the index of the chunk where the given article is, or where it goes:
+ * the first chunk whose last article is not lower than it, or the last chunk. The list must not be empty */
+static int list_find_chunk(struct sorted_list *list,
+                           struct article *item)
+{
+    int low = 0, high = list->chunk_count - 1;
+    
+    while (low < high)
+    {
+        int               middle = (low + high) / 2;
+        struct list_chunk *chunk = list->chunks[middle];
+        STAT_COUNT(visits,
+                   1);
+        if (compare_items(chunk->items[chunk->count - 1],
+                          item,
+                          list->type) < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    
+    return low;
+}
+
+/* The function adds a chunk to the directory of the list at the given index.
+ * It returns 0 on success, -1 if memory allocation fails */
+static int list_add_chunk(struct sorted_list *list,
+                          int index,
+                          struct list_chunk *chunk)
+{
+    if (list->chunk_count == list->chunk_capacity)
+    {
+        int               capacity = list->chunk_capacity == 0 ? 16 : list->chunk_capacity * 2;
+        struct list_chunk **chunks = (struct list_chunk **) realloc(list->chunks,
+                                                                   capacity * sizeof(struct list_chunk *));
+        if (chunks == NULL)
+        {
+            printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+            return -1;
+        }
+        list->chunks         = chunks;
+        list->chunk_capacity = capacity;
+    }
+    
+    memmove(&list->chunks[index + 1],
+            &list->chunks[index],
+            (list->chunk_count - index) * sizeof(struct list_chunk *));
+    list->chunks[index] = chunk;
+    list->chunk_count++;
+    
+    return 0;
+}
+
+/* The function removes the chunk at the given index from the directory of the list and gives it back to the pool */
+static void list_remove_chunk(struct memory_pool *pool,
+                              struct sorted_list *list,
+                              int index)
+{
+    pool_release(pool,
+                 list->chunks[index]);
+    memmove(&list->chunks[index],
+            &list->chunks[index + 1],
+            (list->chunk_count - index - 1) * sizeof(struct list_chunk *));
+    list->chunk_count--;
+}
+
+/* The function inserts an article in the sorted list, in O(log n) comparisons plus the shift of at most
+ * a chunk. A full chunk is split in two halves. An article already in the list is ignored.
+ * It returns 0 on success, -1 if memory allocation fails */
+int insert_in_list(struct memory_pool *pool,
+                   struct sorted_list *list,
+                   struct article *item)
+{
+    STAT_BEGIN(STAT_LIST_INSERT);
+    if (list->chunk_count == 0)
+    {
+        struct list_chunk *first = (struct list_chunk *) pool_alloc(pool);
+        if (first == NULL)
+        {
+            STAT_END();
+            return -1;
+        }
+        first->count = 0;
+        if (list_add_chunk(list,
+                           0,
+                           first) != 0)
+        {
+            pool_release(pool,
+                         first);
+            STAT_END();
+            return -1;
+        }
+    }
+    
+    int               index    = list_find_chunk(list,
+                                                 item);
+    struct list_chunk *chunk   = list->chunks[index];
+    int               position = chunk_lower_bound(chunk,
+                                                   item,
+                                                   list->type);
+    
+    if (position < chunk->count && compare_items(chunk->items[position],
+                                                 item,
+                                                 list->type) == 0)
+    {
+        STAT_END();
+        return 0;
+    }
+    
+    /* Splitting a full chunk, the upper half moves to a new chunk after it */
+    if (chunk->count == LIST_CHUNK_CAPACITY)
+    {
+        struct list_chunk *upper = (struct list_chunk *) pool_alloc(pool);
+        if (upper == NULL)
+        {
+            STAT_END();
+            return -1;
+        }
+        if (list_add_chunk(list,
+                           index + 1,
+                           upper) != 0)
+        {
+            pool_release(pool,
+                         upper);
+            STAT_END();
+            return -1;
+        }
+        
+        int half = LIST_CHUNK_CAPACITY / 2;
+        upper->count = chunk->count - half;
+        memcpy(upper->items,
+               &chunk->items[half],
+               upper->count * sizeof(struct article *));
+        chunk->count = half;
+        
+        if (position > half)
+        {
+            chunk = upper;
+            position -= half;
+        }
+    }
+    
+    memmove(&chunk->items[position + 1],
+            &chunk->items[position],
+            (chunk->count - position) * sizeof(struct article *));
+    chunk->items[position] = item;
+    chunk->count++;
+    list->count++;
+    
+    STAT_END();
+    return 0;
+}
+
+/* Function to print a list, chunk after chunk, through the output buffer */
+void print_list(struct sorted_list *list)
+{
+    int i, j;
+    
+    for (i = 0; i < list->chunk_count; i++)
+    {
+        struct list_chunk *chunk = list->chunks[i];
+        for (j = 0; j < chunk->count; j++)
+        {
+            char *id = output_reserve(ID_LENGTH + 2);
+            unpack_id(chunk->items[j]->product_id,
+                      id);
+            id[ID_LENGTH]     = ',';
+            id[ID_LENGTH + 1] = ' ';
+            output.used += ID_LENGTH + 2;
+        }
+    }
+    
+    output_flush();
+}
+
+/* The function acquires a sorted list and one of its articles, then removes the article in O(log n) comparisons
+ * plus the shift of at most a chunk. An empty chunk is given back to the pool, and a chunk is merged with
+ * the next one when both fit in half a chunk. It returns 0 on success, -1 if the article is not in the list */
+int remove_list_item(struct memory_pool *pool,
+                     struct sorted_list *list,
+                     struct article *item)
+{
+    if (list->chunk_count == 0)
+    {
+        return -1;
+    }
+    
+    STAT_BEGIN(STAT_LIST_REMOVE);
+    int               index    = list_find_chunk(list,
+                                                 item);
+    struct list_chunk *chunk   = list->chunks[index];
+    int               position = chunk_lower_bound(chunk,
+                                                   item,
+                                                   list->type);
+    
+    if (position == chunk->count || chunk->items[position] != item)
+    {
+        STAT_END();
+        return -1;
+    }
+    
+    memmove(&chunk->items[position],
+            &chunk->items[position + 1],
+            (chunk->count - position - 1) * sizeof(struct article *));
+    chunk->count--;
+    list->count--;
+    
+    if (chunk->count == 0)
+    {
+        list_remove_chunk(pool,
+                          list,
+                          index);
+    }
+    else if (index + 1 < list->chunk_count &&
+             chunk->count + list->chunks[index + 1]->count <= LIST_CHUNK_CAPACITY / 2)
+    {
+        struct list_chunk *next = list->chunks[index + 1];
+        memcpy(&chunk->items[chunk->count],
+               next->items,
+               next->count * sizeof(struct article *));
+        chunk->count += next->count;
+        list_remove_chunk(pool,
+                          list,
+                          index + 1);
+    }
+    
+    STAT_END();
+    return 0;
+}
+
+/* Checks whether the product id is present in list. A list sorted by product id is searched with a binary search,
+ * otherwise the chunks are scanned in order and the first match is returned */
+struct article *search_in_list(struct sorted_list *list,
+                               uint32_t product_id)
+{
+    int i, j;
+    
+    if (list->chunk_count == 0)
+    {
+        return NULL;
+    }
+    
+    STAT_BEGIN(STAT_LIST_SEARCH);
+    if (list->type == TYPE_PRODUCT_ID)
+    {
+        struct article key;
+        key.product_id = product_id;
+        
+        struct list_chunk *chunk   = list->chunks[list_find_chunk(list,
+                                                                  &key)];
+        int               position = chunk_lower_bound(chunk,
+                                                       &key,
+                                                       TYPE_PRODUCT_ID);
+        
+        STAT_END();
+        return position < chunk->count && chunk->items[position]->product_id == product_id ?
+               chunk->items[position] : NULL;
+    }
+    
+    for (i = 0; i < list->chunk_count; i++)
+    {
+        STAT_COUNT(visits,
+                   1);
+        for (j = 0; j < list->chunks[i]->count; j++)
+        {
+            STAT_COUNT(comparisons,
+                       1);
+            if (list->chunks[i]->items[j]->product_id == product_id)
+            {
+                STAT_END();
+                return list->chunks[i]->items[j];
+            }
+        }
+    }
+    
+    STAT_END();
+    return NULL;
+}
+
+/* The function acquires an empty sorted list and an array of articles in list order, and fills the list in O(n),
+ * LIST_BUILD_FILL articles per chunk. It returns 0 on success, -1 if memory allocation fails */
+int build_list(struct memory_pool *pool,
+               struct sorted_list *list,
+               struct article **items,
+               int count)
+{
+    int i;
+    
+    for (i = 0; i < count; i += LIST_BUILD_FILL)
+    {
+        struct list_chunk *chunk = (struct list_chunk *) pool_alloc(pool);
+        if (chunk == NULL)
+        {
+            return -1;
+        }
+        
+        chunk->count = count - i < LIST_BUILD_FILL ? count - i : LIST_BUILD_FILL;
+        memcpy(chunk->items,
+               &items[i],
+               chunk->count * sizeof(struct article *));
+        
+        if (list_add_chunk(list,
+                           list->chunk_count,
+                           chunk) != 0)
+        {
+            pool_release(pool,
+                         chunk);
+            return -1;
+        }
+        list->count += chunk->count;
+    }
+    
+    return 0;
+}
+
+/* The function copies the articles of the list in order in the given array (with room for all of them).
+ * It returns the number of articles */
+int list_to_array(struct sorted_list *list,
+                  struct article **items)
+{
+    int count = 0, i;
+    
+    for (i = 0; i < list->chunk_count; i++)
+    {
+        memcpy(&items[count],
+               list->chunks[i]->items,
+               list->chunks[i]->count * sizeof(struct article *));
+        count += list->chunks[i]->count;
+    }
+    
+    return count;
+}
+
+/* The function frees the directory of the list, its chunks are freed with their memory pool */
+void list_free(struct sorted_list *list)
+{
+    free(list->chunks);
+    list_init(list,
+              list->type);
+}
+
+
+/* Hash table functions */
+
+/* The function returns the hash of a packed product id, using the murmur3 finalizer to spread its bits */
+unsigned int hash_id(uint32_t product_id)
+{
+    uint32_t hash = product_id;
+    
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    
+    return hash;
+}
+
+/* The function allocates an empty hash table with the given capacity (a power of 2).
+ * It returns 0 on success, -1 if memory allocation fails */
+int hash_init(struct hash_table *table,
+              int capacity)
+{
+    table->entries  = (struct hash_entry *) calloc(capacity,
+                                                   sizeof(struct hash_entry));
+    table->capacity = capacity;
+    table->count    = 0;
+    
+    if (table->entries == NULL)
+    {
+        printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+        return -1;
+    }
+    
+    return 0;
+}
+
+/* The function acquires the hash table and a product id, and returns the entry of that product id, NULL if it doesn't exist.
+ * Probing stops at the first empty slot, so a lookup costs O(1) on average */
+struct hash_entry *hash_search(struct hash_table *table,
+                               uint32_t product_id)
+{
+    unsigned int mask = table->capacity - 1;
+    unsigned int i    = hash_id(product_id) & mask;
+    
+    STAT_BEGIN(STAT_HASH_SEARCH);
+    while (table->entries[i].item != NULL)
+    {
+        STAT_COUNT(visits,
+                   1);
+        STAT_COUNT(comparisons,
+                   1);
+        if (table->entries[i].item->product_id == product_id)
+        {
+            STAT_END();
+            return &table->entries[i];
+        }
+        i = (i + 1) & mask;
+    }
+    
+    STAT_END();
+    return NULL;
+}
+
+/* The function acquires the hash table and an article whose product id is not already in the table.
+ * The table is doubled when it is 70% full. It returns 0 on success, -1 if memory allocation fails */
+int hash_insert(struct hash_table *table,
+                struct article *item)
+{
+    STAT_BEGIN(STAT_HASH_INSERT);
+    
+    /* Growing the table */
+    if ((table->count + 1) * 10 > table->capacity * 7 && hash_resize(table,
+                                                                    table->capacity * 2) != 0)
+    {
+        STAT_END();
+        return -1;
+    }
+    
+    unsigned int mask = table->capacity - 1;
+    unsigned int i    = hash_id(item->product_id) & mask;
+    
+    while (table->entries[i].item != NULL)
+    {
+        STAT_COUNT(visits,
+                   1);
+        i = (i + 1) & mask;
+    }
+    
+    table->entries[i].item = item;
+    table->count++;
+    
+    STAT_END();
+    return 0;
+}
+
+/* The function moves every entry of the hash table in a new array of the given capacity (a power of 2).
+ * It returns 0 on success, -1 if memory allocation fails */
+int hash_resize(struct hash_table *table,
+                int capacity)
+{
+    struct hash_table resized;
+    int               i;
+    
+    if (capacity == table->capacity)
+    {
+        return 0;
+    }
+    
+    if (hash_init(&resized,
+                  capacity) != 0)
+    {
+        return -1;
+    }
+    
+    /* The entries are placed directly: the new table has room for all of them */
+    STAT_COUNT(allocations,
+               1);
+    for (i = 0; i < table->capacity; i++)
+    {
+        if (table->entries[i].item != NULL)
+        {
+            unsigned int slot = hash_id(table->entries[i].item->product_id) & (capacity - 1);
+            while (resized.entries[slot].item != NULL)
+            {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            resized.entries[slot] = table->entries[i];
+            resized.count++;
+        }
+    }
+    
+    free(table->entries);
+    *table = resized;
+    
+    return 0;
+}
+
+/* The function acquires the hash table and one of its entries, and removes that entry.
+ * Following entries of the same probe sequence are shifted back, so no tombstone is left behind */
+void hash_remove(struct hash_table *table,
+                 struct hash_entry *entry)
+{
+    unsigned int mask = table->capacity - 1;
+    unsigned int hole = (unsigned int) (entry - table->entries);
+    unsigned int i    = (hole + 1) & mask;
+    
+    STAT_BEGIN(STAT_HASH_REMOVE);
+    while (table->entries[i].item != NULL)
+    {
+        STAT_COUNT(visits,
+                   1);
+        unsigned int home = hash_id(table->entries[i].item->product_id) & mask;
+        
+        /* The entry can fill the hole only if its home slot is not between the hole and its current slot */
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            table->entries[hole] = table->entries[i];
+            hole = i;
+        }
+        i = (i + 1) & mask;
+    }
+    
+    table->entries[hole].item = NULL;
+    table->count--;
+    STAT_END();
+}
+
+/* The function frees the hash table slots */
+void hash_free(struct hash_table *table)
+{
+    free(table->entries);
+    table->entries  = NULL;
+    table->capacity = 0;
+    table->count    = 0;
+}
+
+
+/* Aggregate functions */
+
+/* The function initializes an empty table of aggregates of the given type with the given capacity (a power of 2).
+ * It returns 0 on success, -1 if memory allocation fails */
+int group_init(struct group_table *table,
+               int capacity,
+               int type)
+{
+    table->entries  = (struct aggregate *) calloc(capacity,
+                                                  sizeof(struct aggregate));
+    table->capacity = capacity;
+    table->count    = 0;
+    table->type     = type;
+    
+    if (table->entries == NULL)
+    {
+        printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+        return -1;
+    }
+    
+    return 0;
+}
+
+/* The function returns 1 if the article belongs to the group of the table (same name or same piece id), 0 otherwise */
+static int group_contains(struct group_table *table,
+                          struct aggregate *group,
+                          struct article *item)
+{
+    if (table->type == GROUP_BY_NAME)
+    {
+        return group->name_length == item->name_length && memcmp(group->name,
+                                                                 item->name,
+                                                                 item->name_length) == 0;
+    }
+    
+    return group->piece_id == item->piece_id;
+}
+
+/* The function returns the slot of the group of the given article (its name or its piece id, depending on the table).
+ * With create, a missing group is added (the table is doubled when it is 70% full).
+ * It returns NULL if the group doesn't exist and it is not created, or if memory allocation fails */
+struct aggregate *group_find(struct group_table *table,
+                             struct article *item,
+                             int create)
+{
+    unsigned int mask = table->capacity - 1;
+    unsigned int i    = (table->type == GROUP_BY_NAME ? hash_string(item->name,
+                                                                    item->name_length) : hash_id(item->piece_id)) & mask;
+    
+    while (table->entries[i].name != NULL)
+    {
+        struct aggregate *group = &table->entries[i];
+        if (group_contains(table,
+                           group,
+                           item))
+        {
+            return group;
+        }
+        i = (i + 1) & mask;
+    }
+    
+    if (!create)
+    {
+        return NULL;
+    }
+    
+    /* Growing the table and looking for the slot again */
+    if ((table->count + 1) * 10 > table->capacity * 7)
+    {
+        struct group_table bigger;
+        int                j;
+        
+        if (group_init(&bigger,
+                       table->capacity * 2,
+                       table->type) != 0)
+        {
+            return NULL;
+        }
+        for (j = 0; j < table->capacity; j++)
+        {
+            if (table->entries[j].name != NULL)
+            {
+                unsigned int k = (table->type == GROUP_BY_NAME ? hash_string(table->entries[j].name,
+                                                                             table->entries[j].name_length)
+                                                               : hash_id(table->entries[j].piece_id)) &
+                                 (bigger.capacity - 1);
+                while (bigger.entries[k].name != NULL)
+                {
+                    k = (k + 1) & (bigger.capacity - 1);
+                }
+                bigger.entries[k] = table->entries[j];
+                bigger.count++;
+            }
+        }
+        free(table->entries);
+        *table = bigger;
+        
+        return group_find(table,
+                          item,
+                          1);
+    }
+    
+    /* The name of the article lives as long as the data set (string pool or mapped file), so it is not copied */
+    struct aggregate *group = &table->entries[i];
+    group->name        = item->name;
+    group->name_length = item->name_length;
+    group->piece_id    = item->piece_id;
+    table->count++;
+    
+    return group;
+}
+
+/* The function adds the process time of an article to a group. A value not above a stale minimum (the bound)
+ * is the exact minimum again, the same for the maximum */
+static int group_add(struct aggregate *group,
+                     int32_t process_time)
+{
+    if (group->count == 0 || process_time < group->min || (group->min_stale && process_time == group->min))
+    {
+        group->min       = process_time;
+        group->min_stale = 0;
+    }
+    if (group->count == 0 || process_time > group->max || (group->max_stale && process_time == group->max))
+    {
+        group->max       = process_time;
+        group->max_stale = 0;
+    }
+    group->count++;
+    group->sum += process_time;
+    
+    return sketch_add(&group->sketch,
+                      process_time,
+                      1);
+}
+
+/* The function adds an article to the aggregates of its name and of its piece id.
+ * It returns 0 on success, -1 if memory allocation fails */
+int aggregate_add(struct data_set *data,
+                  struct article *item)
+{
+    struct aggregate *by_name = group_find(&data->by_name,
+                                           item,
+                                           1);
+    if (by_name == NULL || group_add(by_name,
+                                     item->process_time) != 0)
+    {
+        return -1;
+    }
+    
+    struct aggregate *by_piece_id = group_find(&data->by_piece_id,
+                                               item,
+                                               1);
+    if (by_piece_id == NULL || group_add(by_piece_id,
+                                         item->process_time) != 0)
+    {
+        return -1;
+    }
+    
+    return 0;
+}
+
+/* The function removes a process time from a group in O(1), plus the update of the sketch. A removed minimum
+ * (or maximum) is not looked for here: it is kept as a bound and marked stale, group_resolve() finds the exact one
+ * when the group is printed */
+static void group_remove(struct aggregate *group,
+                         int32_t process_time)
+{
+    sketch_add(&group->sketch,
+               process_time,
+               -1);
+    group->count--;
+    group->sum -= process_time;
+    
+    if (group->count > 0 && process_time == group->min)
+    {
+        group->min_stale = 1;
+    }
+    if (group->count > 0 && process_time == group->max)
+    {
+        group->max_stale = 1;
+    }
+}
+
+/* The function removes an article from the aggregates of its name and of its piece id */
+void aggregate_remove(struct data_set *data,
+                      struct article *item)
+{
+    struct aggregate *by_name     = group_find(&data->by_name,
+                                               item,
+                                               0);
+    struct aggregate *by_piece_id = group_find(&data->by_piece_id,
+                                               item,
+                                               0);
+    
+    if (by_name != NULL)
+    {
+        group_remove(by_name,
+                     item->process_time);
+    }
+    if (by_piece_id != NULL)
+    {
+        group_remove(by_piece_id,
+                     item->process_time);
+    }
+}
+
+/* The function replaces a stale minimum (or maximum) of a group with the exact one. The first (or last) bucket of
+ * the sketch holds it, so only the articles of the process time tree between the bound and the end of that bucket
+ * are visited, whatever the size of the group */
+void group_resolve(struct group_table *table,
+                   struct aggregate *group,
+                   struct node *root_process_time)
+{
+    struct tree_cursor cursor;
+    struct article     key, *item;
+    int32_t            low, high;
+    
+    if (group->count > 0 && group->min_stale)
+    {
+        sketch_bounds(group->sketch.buckets[0].index,
+                      &low,
+                      &high);
+        key.process_time = low > group->min ? low : group->min;
+        key.product_id   = 0;
+        for (cursor_seek(&cursor,
+                         root_process_time,
+                         &key,
+                         TYPE_PROCESS_TIME); (item = cursor_item(&cursor)) != NULL && item->process_time <= high;
+             cursor_next(&cursor))
+        {
+            if (group_contains(table,
+                               group,
+                               item))
+            {
+                group->min       = item->process_time;
+                group->min_stale = 0;
+                break;
+            }
+        }
+    }
+    if (group->count > 0 && group->max_stale)
+    {
+        sketch_bounds(group->sketch.buckets[group->sketch.count - 1].index,
+                      &low,
+                      &high);
+        high = high < group->max ? high : group->max;
+        
+        /* The cursor starts from the last article not greater than the bound */
+        key.process_time = high;
+        key.product_id   = UINT32_MAX;
+        cursor_seek(&cursor,
+                    root_process_time,
+                    &key,
+                    TYPE_PROCESS_TIME);
+        if (cursor.depth > 0 && compare_items(cursor_item(&cursor),
+                                              &key,
+                                              TYPE_PROCESS_TIME) > 0)
+        {
+            cursor_prev(&cursor);
+        }
+        else
+        {
+            cursor_last(&cursor,
+                        root_process_time);
+        }
+        for (; (item = cursor_item(&cursor)) != NULL && item->process_time >= low; cursor_prev(&cursor))
+        {
+            if (group_contains(table,
+                               group,
+                               item))
+            {
+                group->max       = item->process_time;
+                group->max_stale = 0;
+                break;
+            }
+        }
+    }
+}
+
+/* The function returns the process time at the given fraction (0 to 1) of a group, estimated with its sketch
+ * and kept between the minimum and the maximum of the group */
+int32_t aggregate_quantile(struct aggregate *group,
+                           double fraction)
+{
+    int32_t value = sketch_quantile(&group->sketch,
+                                    fraction);
+    
+    return value < group->min ? group->min : value > group->max ? group->max : value;
+}
+
+/* The function prints a row of statistics of a group, with the given label */
+void print_aggregate(const char *label,
+                     int label_length,
+                     struct aggregate *group)
+{
+    printf("%-20.*s%8d%10.1f%8d%8d%8d%8d\n",
+           label_length,
+           label,
+           group->count,
+           (double) group->sum / group->count,
+           group->min,
+           aggregate_quantile(group,
+                              0.5),
+           aggregate_quantile(group,
+                              0.95),
+           group->max);
+}
+
+/* The function prints the statistics of every non empty group of the table (names are listed as they are found
+ * in the table), followed by the total: the sketches of all the groups are merged to get its quantiles */
+void print_groups(struct group_table *table,
+                  struct node *root_process_time)
+{
+    struct aggregate total;
+    int              i;
+    
+    memset(&total,
+           0,
+           sizeof(struct aggregate));
+    
+    printf("\n%-20s%8s%10s%8s%8s%8s%8s\n",
+           table->type == GROUP_BY_NAME ? "Name" : "Piece id",
+           "Items",
+           "Mean",
+           "Min",
+           "Median",
+           "p95",
+           "Max");
+    printf("------------------------------------------------------------------------\n");
+    
+    for (i = 0; i < table->capacity; i++)
+    {
+        struct aggregate *group = &table->entries[i];
+        if (group->name != NULL && group->count > 0)
+        {
+            group_resolve(table,
+                          group,
+                          root_process_time);
+            if (table->type == GROUP_BY_NAME)
+            {
+                print_aggregate(group->name,
+                                (int) group->name_length,
+                                group);
+            }
+            else
+            {
+                char piece_id[ID_LENGTH + 1];
+                unpack_id(group->piece_id,
+                          piece_id);
+                print_aggregate(piece_id,
+                                ID_LENGTH,
+                                group);
+            }
+            
+            if (total.count == 0 || group->min < total.min)
+            {
+                total.min = group->min;
+            }
+            if (total.count == 0 || group->max > total.max)
+            {
+                total.max = group->max;
+            }
+            total.count += group->count;
+            total.sum += group->sum;
+            sketch_merge(&total.sketch,
+                         &group->sketch);
+        }
+    }
+    
+    printf("------------------------------------------------------------------------\n");
+    if (total.count > 0)
+    {
+        print_aggregate("Total",
+                        5,
+                        &total);
+    }
+    free(total.sketch.buckets);
+}
+
+/* The function frees the table of aggregates and their sketches */
+void group_free(struct group_table *table)
+{
+    int i;
+    
+    for (i = 0; i < table->capacity; i++)
+    {
+        free(table->entries[i].sketch.buckets);
+    }
+    free(table->entries);
+    table->entries  = NULL;
+    table->capacity = 0;
+    table->count    = 0;
+}
+
+/* The function returns the index of the sketch bucket of a process time (negative values go in the first bucket) */
+int sketch_index(int32_t value)
+{
+    if (value < SKETCH_SUB_BUCKETS)
+    {
+        return value < 0 ? 0 : value;
+    }
+    
+    int exponent = 31 - __builtin_clz((unsigned int) value);
+    
+    return (exponent - SKETCH_SUB_BITS + 1) * SKETCH_SUB_BUCKETS +
+           ((value >> (exponent - SKETCH_SUB_BITS)) & (SKETCH_SUB_BUCKETS - 1));
+}
+
+/* The function returns the value that represents a sketch bucket: the middle of the values of the bucket */
+int32_t sketch_value(int index)
+{
+    if (index < SKETCH_SUB_BUCKETS)
+    {
+        return index;
+    }
+    
+    int shift = index / SKETCH_SUB_BUCKETS - 1;
+    int32_t low = (SKETCH_SUB_BUCKETS + index % SKETCH_SUB_BUCKETS) << shift;
+    
+    return low + ((1 << shift) - 1) / 2;
+}
+
+/* The function returns the lowest and the highest value that fall in a sketch bucket (the first one also holds
+ * every negative value) */
+void sketch_bounds(int index,
+                   int32_t *low,
+                   int32_t *high)
+{
+    if (index < SKETCH_SUB_BUCKETS)
+    {
+        *low  = index == 0 ? INT32_MIN : index;
+        *high = index;
+        return;
+    }
+    
+    int shift = index / SKETCH_SUB_BUCKETS - 1;
+    *low  = (SKETCH_SUB_BUCKETS + index % SKETCH_SUB_BUCKETS) << shift;
+    *high = *low + ((1 << shift) - 1);
+}
+
+/* The function adds delta (1 to add a value, -1 to remove it) to the bucket of a value, keeping the buckets in order.
+ * A bucket whose count drops to 0 is removed. It returns 0 on success, -1 if memory allocation fails */
+int sketch_add(struct quantile_sketch *sketch,
+               int32_t value,
+               int delta)
+{
+    int index = sketch_index(value);
+    int low   = 0, high = sketch->count;
+    
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (sketch->buckets[middle].index < index)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    
+    if (low < sketch->count && sketch->buckets[low].index == index)
+    {
+        sketch->buckets[low].count += delta;
+        if (sketch->buckets[low].count == 0)
+        {
+            memmove(&sketch->buckets[low],
+                    &sketch->buckets[low + 1],
+                    (sketch->count - low - 1) * sizeof(struct sketch_bucket));
+            sketch->count--;
+        }
+        return 0;
+    }
+    
+    if (delta < 0)
+    {
+        return 0;
+    }
+    
+    if (sketch->count == sketch->capacity)
+    {
+        int                  capacity = sketch->capacity == 0 ? 2 : sketch->capacity * 2;
+        struct sketch_bucket *buckets = (struct sketch_bucket *) realloc(sketch->buckets,
+                                                                         capacity * sizeof(struct sketch_bucket));
+        if (buckets == NULL)
+        {
+            printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+            return -1;
+        }
+        sketch->buckets  = buckets;
+        sketch->capacity = capacity;
+    }
+    
+    memmove(&sketch->buckets[low + 1],
+            &sketch->buckets[low],
+            (sketch->count - low) * sizeof(struct sketch_bucket));
+    sketch->buckets[low].index = (uint16_t) index;
+    sketch->buckets[low].count = delta;
+    sketch->count++;
+    
+    return 0;
+}
+
+/* The function adds every bucket of a sketch to another one, merging the two ordered arrays of buckets.
+ * It returns 0 on success, -1 if memory allocation fails */
+int sketch_merge(struct quantile_sketch *into,
+                 struct quantile_sketch *from)
+{
+    int                  capacity = into->count + from->count + 1;
+    struct sketch_bucket *merged  = (struct sketch_bucket *) malloc(capacity * sizeof(struct sketch_bucket));
+    int                  i = 0, j = 0, count = 0;
+    
+    if (merged == NULL)
+    {
+        printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+        return -1;
+    }
+    
+    while (i < into->count || j < from->count)
+    {
+        if (j == from->count || (i < into->count && into->buckets[i].index < from->buckets[j].index))
+        {
+            merged[count++] = into->buckets[i++];
+        }
+        else if (i == into->count || from->buckets[j].index < into->buckets[i].index)
+        {
+            merged[count++] = from->buckets[j++];
+        }
+        else
+        {
+            merged[count] = into->buckets[i++];
+            merged[count++].count += from->buckets[j++].count;
+        }
+    }
+    
+    free(into->buckets);
+    into->buckets  = merged;
+    into->count    = count;
+    into->capacity = capacity;
+    
+    return 0;
+}
+
+/* The function returns the value at the given fraction (0 to 1) of the values of the sketch, nearest-rank method.
+ * It returns 0 for an empty sketch */
+int32_t sketch_quantile(struct quantile_sketch *sketch,
+                        double fraction)
+{
+    long total = 0, seen = 0;
+    int  i;
+    
+    for (i = 0; i < sketch->count; i++)
+    {
+        total += sketch->buckets[i].count;
+    }
+    
+    long rank = nearest_rank(fraction,
+                             total);
+    
+    for (i = 0; i < sketch->count; i++)
+    {
+        seen += sketch->buckets[i].count;
+        if (seen >= rank)
+        {
+            return sketch_value(sketch->buckets[i].index);
+        }
+    }
+    
+    return 0;
+}
+
+
+/* Memory pool functions */
+
+/* The function initializes an empty memory pool for objects of the given size.
+ * No memory is allocated until the first object is requested */
+void pool_init(struct memory_pool *pool,
+               size_t object_size)
+{
+    /* Every object must be able to hold the free list pointer, and keep pointers aligned */
+    if (object_size < sizeof(void *))
+    {
+        object_size = sizeof(void *);
+    }
+    object_size = (object_size + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *);
+    
+    pool->blocks         = NULL;
+    pool->free_list      = NULL;
+    pool->object_size    = object_size;
+    pool->block_used     = POOL_BLOCK_OBJECTS; /* No room left, the first allocation creates a block */
+    pool->objects        = 0;
+    pool->block_count    = 0;
+    pool->mapped         = NULL;
+    pool->mapped_length  = 0;
+    pool->mapped_objects = 0;
+}
+
+/* The function returns an object of the pool: a recycled one if the free list is not empty,
+ * otherwise the next unused object of the newest block, allocating a new block when it is full.
+ * It returns NULL if memory allocation fails */
+void *pool_alloc(struct memory_pool *pool)
+{
+    void *object;
+    
+    STAT_COUNT(allocations,
+               1);
+    if (pool->free_list != NULL)
+    {
+        object          = pool->free_list;
+        pool->free_list = *(void **) object;
+    }
+    else
+    {
+        if (pool->block_used == POOL_BLOCK_OBJECTS)
+        {
+            struct pool_block *block = (struct pool_block *) malloc(sizeof(struct pool_block) +
+                                                                    pool->object_size * POOL_BLOCK_OBJECTS);
+            if (block == NULL)
+            {
+                printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+                return NULL;
+            }
+            block->next      = pool->blocks;
+            pool->blocks     = block;
+            pool->block_used = 0;
+            pool->block_count++;
+        }
+        
+        object = (char *) (pool->blocks + 1) + pool->object_size * pool->block_used;
+        pool->block_used++;
+    }
+    
+    pool->objects++;
+    
+    return object;
+}
+
+/* The function gives an object back to its pool, it will be recycled by the next allocation.
+ * An object of the mapped file is only counted as released: the mapping is not the pool's to recycle */
+void pool_release(struct memory_pool *pool,
+                  void *object)
+{
+    if ((char *) object >= pool->mapped && (char *) object < pool->mapped + pool->mapped_length)
+    {
+        pool->mapped_objects--;
+        return;
+    }
+    
+    *(void **) object = pool->free_list;
+    pool->free_list   = object;
+    pool->objects--;
+}
+
+/* The function frees every block of the pool, and with them every object allocated from it */
+void pool_destroy(struct memory_pool *pool)
+{
+    while (pool->blocks != NULL)
+    {
+        struct pool_block *next = pool->blocks->next;
+        free(pool->blocks);
+        pool->blocks = next;
+    }
+    
+    pool_init(pool,
+              pool->object_size);
+}
+
+
+/* The function acquires a block allocated elsewhere (a pool_block header followed by the given number of objects,
+ * all in use) and hands it over to the pool: the objects will be recycled by the pool and freed with it */
+void pool_adopt(struct memory_pool *pool,
+                struct pool_block *block,
+                long objects)
+{
+    /* The adopted block goes after the newest block, whose unused objects are still handed out */
+    if (pool->blocks == NULL)
+    {
+        block->next  = NULL;
+        pool->blocks = block;
+    }
+    else
+    {
+        block->next        = pool->blocks->next;
+        pool->blocks->next = block;
+    }
+    
+    pool->objects += objects;
+    pool->block_count++;
+}
+
+/* The function acquires count objects of the pool size in a mapped file, all in use, and lets them be released
+ * to the pool like its own ones. They are counted apart and never recycled, the mapping outlives the pool */
+void pool_map(struct memory_pool *pool,
+              void *objects,
+              long count)
+{
+    pool->mapped         = (char *) objects;
+    pool->mapped_length  = count * pool->object_size;
+    pool->mapped_objects = count;
+}
+
+
+/* String pool functions */
+
+/* The function initializes an empty string pool whose set has the given capacity (a power of 2).
+ * It returns 0 on success, -1 if memory allocation fails */
+int string_pool_init(struct string_pool *pool,
+                     int capacity)
+{
+    pool->chunks   = NULL;
+    pool->slots    = (const char **) calloc(capacity,
+                                            sizeof(const char *));
+    pool->capacity = capacity;
+    pool->count    = 0;
+    
+    if (pool->slots == NULL)
+    {
+        printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+        return -1;
+    }
+    
+    return 0;
+}
+
+/* The function returns the FNV-1a hash of a string of the given length */
+static unsigned int hash_string(const char *string,
+                                size_t length)
+{
+    unsigned int hash = 2166136261u;
+    
+    while (length-- > 0)
+    {
+        hash ^= (unsigned char) *string++;
+        hash *= 16777619u;
+    }
+    
+    return hash;
+}
+
+/* The function acquires the string pool and a string of the given length (not necessarily null terminated),
+ * and returns the pooled, null terminated copy of that string.
+ * The string is copied at the end of the last chunk only the first time it is seen,
+ * afterwards the same pointer is returned. It returns NULL if memory allocation fails */
+const char *intern_string(struct string_pool *pool,
+                          const char *string,
+                          size_t length)
+{
+    unsigned int mask = pool->capacity - 1;
+    unsigned int i    = hash_string(string,
+                                    length) & mask;
+    
+    while (pool->slots[i] != NULL)
+    {
+        if (memcmp(pool->slots[i],
+                   string,
+                   length) == 0 && pool->slots[i][length] == '\0')
+        {
+            return pool->slots[i];
+        }
+        i = (i + 1) & mask;
+    }
+    
+    /* Copying the string in the current chunk, or in a new one if it doesn't fit */
+    if (pool->chunks == NULL || pool->chunks->size - pool->chunks->used < length + 1)
+    {
+        size_t              size  = length + 1 > STRING_CHUNK_SIZE ? length + 1 : STRING_CHUNK_SIZE;
+        struct string_chunk *chunk = (struct string_chunk *) malloc(sizeof(struct string_chunk) + size);
+        if (chunk == NULL)
+        {
+            printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+            return NULL;
+        }
+        chunk->next  = pool->chunks;
+        chunk->used  = 0;
+        chunk->size  = size;
+        pool->chunks = chunk;
+    }
+    
+    char *copy = pool->chunks->data + pool->chunks->used;
+    memcpy(copy,
+           string,
+           length);
+    copy[length] = '\0';
+    pool->chunks->used += length + 1;
+    
+    pool->slots[i] = copy;
+    pool->count++;
+    
+    /* Doubling the set when it is 70% full */
+    if (pool->count * 10 > pool->capacity * 7)
+    {
+        const char **slots = (const char **) calloc(pool->capacity * 2,
+                                                    sizeof(const char *));
+        if (slots == NULL)
+        {
+            printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+            return NULL;
+        }
+        
+        mask = pool->capacity * 2 - 1;
+        int j;
+        for (j = 0; j < pool->capacity; j++)
+        {
+            if (pool->slots[j] != NULL)
+            {
+                i = hash_string(pool->slots[j],
+                                strlen(pool->slots[j])) & mask;
+                while (slots[i] != NULL)
+                {
+                    i = (i + 1) & mask;
+                }
+                slots[i] = pool->slots[j];
+            }
+        }
+        
+        free(pool->slots);
+        pool->slots = slots;
+        pool->capacity *= 2;
+    }
+    
+    return copy;
+}
+
+/* The function frees every chunk of the string pool and its set */
+void string_pool_free(struct string_pool *pool)
+{
+    while (pool->chunks != NULL)
+    {
+        struct string_chunk *next = pool->chunks->next;
+        free(pool->chunks);
+        pool->chunks = next;
+    }
+    
+    free(pool->slots);
+    pool->slots    = NULL;
+    pool->capacity = 0;
+    pool->count    = 0;
+}
+
+
+/* Time functions */
+
+/* This function acquires a string and validates it in the format HH:MM:SS.
+ * In case the format has not been respected, it requires the string reinsertion.
+ * It returns the time in seconds since midnight. */
+int get_valid_time(char *when)
+{
+    int seconds;
+    do
+    {
+        if (scanf("%8s",
+                  when) != 1)
+        {
+            strcpy(when,
+                   "00:00:00");
+        }
+        seconds = time_to_seconds(when);
+        if (seconds < 0)
+        {
+            clear_buffer();
+            printf("Time must be expressed as hh:mm:ss format. Please re-insert it: \n");
+        }
+    }
+    while (seconds < 0);
+    
+    return seconds;
+}
+
+/* This function calculates and returns the processing time in seconds,
+ * obtained from the entry time and the exit time, both passed as arguments.
+ * It goes through the C library calendar functions, so it is slow and it is no longer used to load data:
+ * it is kept as the reference of the process time benchmark (see bench_process_time()). */
+double get_prod_process_time(char *time_entry,
+                             char *time_exit)
+{
+    double    diff_t;
+    struct tm tm_entry = {0}, tm_exit = {0}, *tm_today;
+    time_t    t_entry, t_exit, rawtime;
+    
+    strptime(time_entry,
+             "%H:%M:%S",
+             &tm_entry);
+    strptime(time_exit,
              "%H:%M:%S",
              &tm_exit);
     
-    time(&rawtime);
-    tm_today = localtime(&rawtime);
+    time(&rawtime);
+    tm_today = localtime(&rawtime);
+    
+    /* Set on entry time and exit time, day, month and current year, in order to make a correct evaluation. */
+    tm_entry.tm_mday = tm_exit.tm_mday = tm_today->tm_mday;
+    tm_entry.tm_mon  = tm_exit.tm_mon  = tm_today->tm_mon;
+    tm_entry.tm_year = tm_exit.tm_year = tm_today->tm_year;
+    
+    /* strptime() doesn't set the daylight saving flag, let mktime() determine it */
+    tm_entry.tm_isdst = tm_exit.tm_isdst = -1;
+    
+    /* Convert the entry time and the exit time from the struct tm format to the suitable type
+     * for storing the calendar format (time_t) in order to calculate the process time. */
+    t_entry = mktime(&tm_entry);
+    t_exit  = mktime(&tm_exit);
+    
+    /* Calculate de time difference in seconds between time exit and time entry. */
+    diff_t = difftime(t_exit,
+                      t_entry);
+    
+    return (diff_t);
+}
+
+/* This function calculates the processing time in seconds from the entry and exit times in seconds since midnight
+ * and the number of midnights crossed between them, with arithmetic only (a shift day has no daylight saving jumps).
+ * With days = -1 (not known) an exit time earlier than the entry time is taken as the next day.
+ * It returns a negative value if the exit comes before the entry */
+int get_process_time(int time_entry,
+                     int time_exit,
+                     int days)
+{
+    if (days < 0)
+    {
+        days = time_exit < time_entry;
+    }
+    
+    return time_exit - time_entry + days * SECONDS_PER_DAY;
+}
+
+/* The function measures the throughput of the process time computation on the given number of random rows,
+ * with the C library calendar functions (get_prod_process_time()) and with parse_time() and get_process_time().
+ * Rows crossing midnight are counted apart, since only the arithmetic version handles them */
+void bench_process_time(long rows)
+{
+    char (*times)[2][9] = (char (*)[2][9]) malloc(rows * sizeof(*times));
+    long i, crossing = 0, mismatches = 0;
+    
+    if (times == NULL || rows <= 0)
+    {
+        printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+        free(times);
+        return;
+    }
+    
+    srand(1);
+    for (i = 0; i < rows; i++)
+    {
+        format_time(rand() % SECONDS_PER_DAY,
+                    times[i][0]);
+        format_time(rand() % SECONDS_PER_DAY,
+                    times[i][1]);
+    }
+    
+    /* The sums keep the compiler from dropping the loops */
+    double  library_sum = 0;
+    clock_t start       = clock();
+    for (i = 0; i < rows; i++)
+    {
+        library_sum += get_prod_process_time(times[i][0],
+                                             times[i][1]);
+    }
+    double library_time = (double) (clock() - start) / CLOCKS_PER_SEC;
+    
+    long arithmetic_sum = 0;
+    start = clock();
+    for (i = 0; i < rows; i++)
+    {
+        arithmetic_sum += get_process_time(parse_time(times[i][0],
+                                                      8),
+                                           parse_time(times[i][1],
+                                                      8),
+                                           -1);
+    }
+    double arithmetic_time = (double) (clock() - start) / CLOCKS_PER_SEC;
+    
+    /* Comparing the results on the rows that don't cross midnight */
+    for (i = 0; i < rows; i++)
+    {
+        int process_time = get_process_time(time_to_seconds(times[i][0]),
+                                            time_to_seconds(times[i][1]),
+                                            -1);
+        if (strcmp(times[i][1],
+                   times[i][0]) < 0)
+        {
+            crossing++;
+        }
+        else if (process_time != (int) get_prod_process_time(times[i][0],
+                                                             times[i][1]))
+        {
+            mismatches++;
+        }
+    }
+    
+    printf("%ld rows, %ld crossing midnight, %ld mismatches (sums %.0f, %ld)\n",
+           rows,
+           crossing,
+           mismatches,
+           library_sum,
+           arithmetic_sum);
+    printf("C library:  %f milliseconds, %.0f rows per second\n",
+           library_time * 1000,
+           library_time > 0 ? rows / library_time : 0);
+    printf("Arithmetic: %f milliseconds, %.0f rows per second\n",
+           arithmetic_time * 1000,
+           arithmetic_time > 0 ? rows / arithmetic_time : 0);
+    
+    free(times);
+}
+
+/* This function converts a time of the given length in the HH:MM:SS format to the number of seconds since midnight.
+ * It returns -1 if the time is not in that format */
+int parse_time(const char *time,
+               size_t length)
+{
+    int i;
+    
+    if (length != 8)
+    {
+        return -1;
+    }
+    
+    for (i = 0; i < 8; i++)
+    {
+        if ((i == 2 || i == 5) ? time[i] != ':' : (time[i] < '0' || time[i] > '9'))
+        {
+            return -1;
+        }
+    }
+    
+    int hours   = (time[0] - '0') * 10 + (time[1] - '0');
+    int minutes = (time[3] - '0') * 10 + (time[4] - '0');
+    int seconds = (time[6] - '0') * 10 + (time[7] - '0');
+    
+    if (hours > 23 || minutes > 59 || seconds > 59)
+    {
+        return -1;
+    }
+    
+    return hours * 3600 + minutes * 60 + seconds;
+}
+
+/* This function converts a null terminated time in the HH:MM:SS format to the number of seconds since midnight.
+ * It returns -1 if the time is not in that format */
+int time_to_seconds(const char *time)
+{
+    return parse_time(time,
+                      strlen(time));
+}
+
+/* This function writes the given number of seconds since midnight in the HH:MM:SS format,
+ * the buffer must have room for 9 characters */
+void format_time(uint32_t seconds,
+                 char *time)
+{
+    uint32_t hours   = seconds / 3600 % 24;
+    uint32_t minutes = seconds / 60 % 60;
+    
+    seconds %= 60;
+    
+    time[0] = (char) ('0' + hours / 10);
+    time[1] = (char) ('0' + hours % 10);
+    time[2] = ':';
+    time[3] = (char) ('0' + minutes / 10);
+    time[4] = (char) ('0' + minutes % 10);
+    time[5] = ':';
+    time[6] = (char) ('0' + seconds / 10);
+    time[7] = (char) ('0' + seconds % 10);
+    time[8] = '\0';
+}
+
+
+/* Output functions */
+
+/* The function returns where the next length bytes can be formatted in the output buffer, writing the buffer first
+ * if they don't fit. The caller adds the bytes actually used to output.used */
+char *output_reserve(size_t length)
+{
+    if (output.used + length > OUTPUT_BUFFER_SIZE)
+    {
+        output_flush();
+    }
+    
+    return output.data + output.used;
+}
+
+/* The function hands the content of the output buffer to stdout. It must be called before printing anything
+ * else on stdout, so that the output stays in order */
+void output_flush()
+{
+    if (output.used > 0)
+    {
+        fwrite(output.data,
+               1,
+               output.used,
+               stdout);
+        output.used = 0;
+    }
+}
+
+/* The function writes a number in decimal at out and returns the position after its last digit */
+char *format_number(int32_t value,
+                    char *out)
+{
+    char     digits[10];
+    int      count     = 0;
+    uint32_t magnitude = value < 0 ? 0u - (uint32_t) value : (uint32_t) value;
+    
+    if (value < 0)
+    {
+        *out++ = '-';
+    }
+    do
+    {
+        digits[count++] = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    }
+    while (magnitude > 0);
+    
+    while (count > 0)
+    {
+        *out++ = digits[--count];
+    }
+    
+    return out;
+}
+
+
+/* General functions */
+
+/* The function acquires the root and print its data in a formatted way */
+void print_data(struct node *root)
+{
+    print_header();
+    print_tree(root);
+    print_footer();
+}
+
+/* The function prints the header of the table of items, a line with the name of the fields for CSV and TSV */
+void print_header()
+{
+    output_flush();
+    if (output.format != FORMAT_COLUMNS)
+    {
+        const char *fields[] = {"product_id", "name", "piece_id", "time_entry", "time_exit", "process_time"};
+        int        i;
+        for (i = 0; i < 6; i++)
+        {
+            printf("%s%c",
+                   fields[i],
+                   i == 5 ? '\n' : output.format == FORMAT_CSV ? ',' : '\t');
+        }
+        return;
+    }
+    
+    printf("\n-------------------------------------------------------------------------------\n");
+    printf("%-15s%-20s%-15s%-20s%-20s\n",
+           "Product id",
+           "Name",
+           "Piece id",
+           "Time entry",
+           "Time exit");
+    printf("-------------------------------------------------------------------------------\n");
+}
+
+/* The function writes the items left in the output buffer and prints the closing line of the table of items */
+void print_footer()
+{
+    output_flush();
+    if (output.format == FORMAT_COLUMNS)
+    {
+        printf("-------------------------------------------------------------------------------\n");
+    }
+}
+
+/* Clear buffer function to avoid scanf errors */
+void clear_buffer()
+{
+    char c;
+    while ((c = getchar()) != '\n' && c != EOF);
+}
+
+int get_valid_int(char *field_name)
+{
+    int  is_valid = 0;
+    int  value;
+    char term;
+    while (!is_valid)
+    {
+        int result = scanf("%d%c",
+                           &value,
+                           &term);
+        
+        /* Nothing left to read (e.g. rows loaded from stdin), 0 lets every menu exit */
+        if (result == EOF)
+        {
+            return 0;
+        }
+        
+        if (result != 2 || term != '\n')
+        {
+            clear_buffer();
+            printf("%s must be of type integer, try again: ",
+                   field_name);
+        }
+        else
+        {
+            is_valid = 1;
+        }
+    }
+    
+    return value;
+}
+
+
+/* Statistics functions */
+#ifdef ENABLE_STATS
+
+/* The function ends the running operation started at the given time: it adds its latency to the counters
+ * and gives the counters back to the operation that was running before */
+void stat_record(long long start,
+                 int previous)
+{
+    struct op_stats *stats  = &op_stats[stat_operation];
+    long long       elapsed = now_ns() - start;
+    
+    stats->calls++;
+    stats->time_ns += elapsed;
+    stats->latency[sketch_index(elapsed > INT32_MAX ? INT32_MAX : (int32_t) elapsed)]++;
+    stat_operation = previous;
+}
+
+/* The function adds the counters of the calling thread to the ones of the finished threads and clears them */
+void stat_flush()
+{
+    int i, j;
+    
+    pthread_mutex_lock(&flushed_lock);
+    for (i = 0; i < STAT_OPERATIONS; i++)
+    {
+        flushed_stats[i].calls       += op_stats[i].calls;
+        flushed_stats[i].comparisons += op_stats[i].comparisons;
+        flushed_stats[i].visits      += op_stats[i].visits;
+        flushed_stats[i].allocations += op_stats[i].allocations;
+        flushed_stats[i].time_ns     += op_stats[i].time_ns;
+        for (j = 0; j < STAT_BUCKETS; j++)
+        {
+            flushed_stats[i].latency[j] += op_stats[i].latency[j];
+        }
+    }
+    pthread_mutex_unlock(&flushed_lock);
+    
+    memset(op_stats,
+           0,
+           sizeof(op_stats));
+}
+
+/* The function prints the counters of every index operation, the ones of the calling thread added to the ones
+ * of the finished threads, with the latency percentiles taken from the log-linear histogram
+ * (the middle of the bucket, within 1/32 of the real value) */
+void print_op_stats()
+{
+    stat_flush();
+    
+    const char *names[STAT_OPERATIONS] = {"tree search", "tree insert", "tree remove", "list search", "list insert",
+                                          "list remove", "hash search", "hash insert", "hash remove", "other"};
+    int        i, j;
+    
+    printf("%-14s%10s%14s%12s%12s%12s%10s%10s%10s%10s\n",
+           "operation",
+           "calls",
+           "comparisons",
+           "visits",
+           "allocs",
+           "total_us",
+           "p50_ns",
+           "p90_ns",
+           "p99_ns",
+           "max_ns");
+    for (i = 0; i < STAT_OPERATIONS; i++)
+    {
+        struct op_stats *stats = &flushed_stats[i];
+        double          fractions[3] = {0.5, 0.9, 0.99};
+        int32_t         values[4]    = {0, 0, 0, 0};
+        int             k            = 0;
+        long            seen         = 0;
+        
+        if (stats->calls == 0 && stats->comparisons == 0 && stats->allocations == 0)
+        {
+            continue;
+        }
+        
+        /* Nearest-rank percentiles, walking the buckets in order */
+        for (j = 0; j < STAT_BUCKETS && stats->calls > 0; j++)
+        {
+            seen += stats->latency[j];
+            while (k < 3 && stats->latency[j] > 0 && seen >= nearest_rank(fractions[k],
+                                                                          stats->calls))
+            {
+                values[k++] = sketch_value(j);
+            }
+            if (stats->latency[j] > 0)
+            {
+                values[3] = sketch_value(j);
+            }
+        }
+        
+        printf("%-14s%10ld%14ld%12ld%12ld%12.1f%10d%10d%10d%10d\n",
+               names[i],
+               stats->calls,
+               stats->comparisons,
+               stats->visits,
+               stats->allocations,
+               stats->time_ns / 1000.0,
+               values[0],
+               values[1],
+               values[2],
+               values[3]);
+    }
+}
+
+/* The function sets every counter back to 0, the ones of the calling thread and the ones of the finished threads */
+void reset_op_stats()
+{
+    memset(op_stats,
+           0,
+           sizeof(op_stats));
+    pthread_mutex_lock(&flushed_lock);
+    memset(flushed_stats,
+           0,
+           sizeof(flushed_stats));
+    pthread_mutex_unlock(&flushed_lock);
+}
+
+#endif
+
+
+/* Benchmark functions */
+
+/* The function builds data sets of 10^3, 10^4, ... articles up to max_rows with random product ids and process times,
+ * and times every index on them: loading, point lookup, insert, delete, in-order scan and range query.
+ * The trees of the data set are changed only as shared indexes, so their insert and delete are timed on those.
+ * Times are wall clock nanoseconds per operation, printed as percentiles over the samples in the output format */
+void run_benchmarks(long max_rows)
+{
+    long rows;
+    
+    if (output.format == FORMAT_COLUMNS)
+    {
+        printf("%-12s%-10s%12s%9s%12s%12s%12s%12s%12s%14s\n",
+               "engine",
+               "operation",
+               "rows",
+               "samples",
+               "min_ns",
+               "p50_ns",
+               "p90_ns",
+               "p99_ns",
+               "mean_ns",
+               "ops_per_s");
+    }
+    else
+    {
+        const char *fields[] = {"engine", "operation", "rows", "samples", "min_ns", "p50_ns", "p90_ns", "p99_ns", "mean_ns", "ops_per_s"};
+        int        i;
+        for (i = 0; i < 10; i++)
+        {
+            printf("%s%c",
+                   fields[i],
+                   i == 9 ? '\n' : output.format == FORMAT_CSV ? ',' : '\t');
+        }
+    }
+    
+    for (rows = BENCH_MIN_ROWS; rows <= max_rows && rows <= INT_MAX - BENCH_BATCH; rows *= 10)
+    {
+        struct article  *articles = (struct article *) malloc((rows + BENCH_BATCH) * sizeof(struct article));
+        struct article  **items   = (struct article **) malloc((rows + BENCH_BATCH) * sizeof(struct article *));
+        int             count     = (int) rows;
+        int             i;
+        
+        if (articles == NULL || items == NULL)
+        {
+            printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+            free(articles);
+            free(items);
+            return;
+        }
+        
+        /* Multiplying by an odd number is a permutation of the 32 bit integers, so the ids are different and scattered.
+         * The last BENCH_BATCH articles are not loaded, they are the ones inserted and deleted */
+        srand(1);
+        for (i = 0; i < count + BENCH_BATCH; i++)
+        {
+            articles[i].name         = "Bench";
+            articles[i].name_length  = 5;
+            articles[i].product_id   = (uint32_t) (i + 1) * 2654435761u;
+            articles[i].piece_id     = articles[i].product_id;
+            articles[i].time_entry   = 0;
+            articles[i].time_exit    = (uint32_t) (rand() % SECONDS_PER_DAY);
+            articles[i].process_time = (int32_t) articles[i].time_exit;
+            items[i] = &articles[i];
+        }
+        
+        int type, failed = 0;
+        for (type = TYPE_PRODUCT_ID; type <= TYPE_PROCESS_TIME && failed == 0; type++)
+        {
+            failed = bench_tree(items,
+                                count,
+                                type);
+        }
+        if (failed == 0)
+        {
+            failed = bench_shared(items,
+                                  count,
+                                  items + count);
+        }
+        for (type = TYPE_PRODUCT_ID; type <= TYPE_PROCESS_TIME && failed == 0; type++)
+        {
+            failed = bench_list(items,
+                                count,
+                                items + count,
+                                type);
+        }
+        if (failed == 0)
+        {
+            failed = bench_hash(items,
+                                count,
+                                items + count);
+        }
+        if (failed != 0)
+        {
+            rows = max_rows;
+        }
+        fflush(stdout);
+        
+        free(articles);
+        free(items);
+    }
+}
+
+/* The function times a tree of the given type built over count articles: loading, lookup, scan and range query.
+ * It returns 0 on success, -1 if memory allocation fails */
+int bench_tree(struct article **items,
+               int count,
+               int type)
+{
+    const char         *engine     = type == TYPE_PRODUCT_ID ? "tree_id" : "tree_time";
+    struct article     **sorted    = (struct article **) malloc(count * sizeof(struct article *));
+    int                iterations  = count >= 10000000 ? 3 : 10;
+    struct memory_pool pool;
+    struct node        *root       = NULL;
+    struct tree_cursor cursor;
+    double             samples[BENCH_SAMPLES];
+    int                picks[BENCH_BATCH];
+    long               missed      = 0;
+    long long          start;
+    int                i, j;
+    
+    if (sorted == NULL)
+    {
+        printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+        return -1;
+    }
+    pool_init(&pool,
+              sizeof(struct node));
+    
+    /* Loading: sorting the articles and building the tree, the first iteration is a warmup */
+    for (i = -1; i < iterations; i++)
+    {
+        pool_destroy(&pool);
+        memcpy(sorted,
+               items,
+               count * sizeof(struct article *));
+        start = now_ns();
+        if ((type == TYPE_PROCESS_TIME && sort_articles(sorted,
+                                                        count,
+                                                        TYPE_PRODUCT_ID) != 0) || sort_articles(sorted,
+                                                                                                count,
+                                                                                                type) != 0 || (root = build_tree(&pool,
+                                                                                                                                 sorted,
+                                                                                                                                 count)) == NULL)
+        {
+            pool_destroy(&pool);
+            free(sorted);
+            return -1;
+        }
+        if (i >= 0)
+        {
+            samples[i] = (double) (now_ns() - start) / count;
+        }
+    }
+    print_bench(engine,
+                "load",
+                count,
+                samples,
+                iterations);
+    
+    /* Point lookup of random loaded articles, descending from the root */
+    for (i = -BENCH_WARMUP; i < BENCH_SAMPLES; i++)
+    {
+        for (j = 0; j < BENCH_BATCH; j++)
+        {
+            picks[j] = rand() % count;
+        }
+        start = now_ns();
+        for (j = 0; j < BENCH_BATCH; j++)
+        {
+            struct article *item = items[picks[j]];
+            struct node    *node = root;
+            if (type == TYPE_PRODUCT_ID)
+            {
+                node = search_id(root,
+                                 item->product_id);
+            }
+            else
+            {
+                int result;
+                while (node != NULL && (result = compare_items(item,
+                                                               node->item,
+                                                               type)) != 0)
+                {
+                    node = result < 0 ? node->left : node->right;
+                }
+            }
+            missed += node == NULL;
+        }
+        if (i >= 0)
+        {
+            samples[i] = (double) (now_ns() - start) / BENCH_BATCH;
+        }
+    }
+    print_bench(engine,
+                "lookup",
+                count,
+                samples,
+                BENCH_SAMPLES);
+    
+    /* In-order scan of the whole tree with a cursor */
+    for (i = -1; i < iterations; i++)
+    {
+        long visited = 0;
+        start = now_ns();
+        for (cursor_first(&cursor,
+                          root); cursor.depth > 0; cursor_next(&cursor))
+        {
+            visited += cursor_item(&cursor)->process_time >= 0;
+        }
+        if (i >= 0)
+        {
+            samples[i] = (double) (now_ns() - start) / count;
+        }
+        missed += visited != count;
+    }
+    print_bench(engine,
+                "scan",
+                count,
+                samples,
+                iterations);
+    
+    /* Range queries on the process time, each one returns BENCH_RANGE_ITEMS articles on average */
+    if (type == TYPE_PROCESS_TIME)
+    {
+        int32_t width = (int32_t) ((long long) BENCH_RANGE_ITEMS * SECONDS_PER_DAY / count);
+        long    returned = 0;
+        
+        for (i = -BENCH_WARMUP; i < BENCH_SAMPLES; i++)
+        {
+            for (j = 0; j < BENCH_RANGES; j++)
+            {
+                picks[j] = rand() % SECONDS_PER_DAY;
+            }
+            start = now_ns();
+            for (j = 0; j < BENCH_RANGES; j++)
+            {
+                struct article key;
+                key.process_time = picks[j];
+                key.product_id   = 0;
+                for (cursor_seek(&cursor,
+                                 root,
+                                 &key,
+                                 TYPE_PROCESS_TIME); cursor.depth > 0 && cursor_item(&cursor)->process_time <= picks[j] + width; cursor_next(&cursor))
+                {
+                    returned++;
+                }
+            }
+            if (i >= 0)
+            {
+                samples[i] = (double) (now_ns() - start) / BENCH_RANGES;
+            }
+        }
+        bench_sink += returned;
+        print_bench(engine,
+                    "range",
+                    count,
+                    samples,
+                    BENCH_SAMPLES);
+    }
+    
+    if (missed > 0)
+    {
+        fprintf(stderr,
+                "[WARNING] %s: %ld checks failed\n",
+                engine,
+                missed);
+    }
+    
+    pool_destroy(&pool);
+    free(sorted);
+    
+    return 0;
+}
+
+/* The function times the shared indexes over count articles: the build of both trees of a version, and the insert
+ * and delete of the BENCH_BATCH articles of extra, each one publishing a new version of both trees by path copying.
+ * Nothing reads the indexes meanwhile, so retired objects are freed as soon as the writer reclaims them.
+ * It returns 0 on success, -1 if memory allocation fails */
+int bench_shared(struct article **items,
+                 int count,
+                 struct article **extra)
+{
+    struct article      **by_product_id   = (struct article **) malloc(count * sizeof(struct article *));
+    struct article      **by_process_time = (struct article **) malloc(count * sizeof(struct article *));
+    int                 iterations        = count >= 10000000 ? 3 : 10;
+    struct shared_index index;
+    double              samples[BENCH_SAMPLES], removals[BENCH_SAMPLES];
+    long                missed            = 0;
+    long long           start;
+    int                 i, j;
+    
+    if (by_product_id == NULL || by_process_time == NULL)
+    {
+        printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+        free(by_product_id);
+        free(by_process_time);
+        return -1;
+    }
+    
+    /* The articles are not in a pool, the removed ones must not be given back to one */
+    memcpy(by_product_id,
+           items,
+           count * sizeof(struct article *));
+    if (sort_articles(by_product_id,
+                      count,
+                      TYPE_PRODUCT_ID) != 0 || shared_init(&index,
+                                                           NULL) != 0)
+    {
+        free(by_product_id);
+        free(by_process_time);
+        return -1;
+    }
+    
+    /* Loading: sorting by process time and building both trees, the first iteration is a warmup */
+    for (i = -1; i < iterations; i++)
+    {
+        memcpy(by_process_time,
+               by_product_id,
+               count * sizeof(struct article *));
+        start = now_ns();
+        if (sort_articles(by_process_time,
+                          count,
+                          TYPE_PROCESS_TIME) != 0 || shared_build(&index,
+                                                                  by_product_id,
+                                                                  by_process_time,
+                                                                  count,
+                                                                  NULL,
+                                                                  0) != 0)
+        {
+            shared_free(&index);
+            free(by_product_id);
+            free(by_process_time);
+            return -1;
+        }
+        if (i >= 0)
+        {
+            samples[i] = (double) (now_ns() - start) / count;
+        }
+        shared_reclaim(&index);
+    }
+    print_bench("shared",
+                "load",
+                count,
+                samples,
+                iterations);
+    
+    /* Insert and delete of the same batch of articles, so the trees keep their size */
+    for (i = -BENCH_WARMUP; i < BENCH_SAMPLES; i++)
+    {
+        start = now_ns();
+        for (j = 0; j < BENCH_BATCH; j++)
+        {
+            missed += shared_insert(&index,
+                                    extra[j]) != 0;
+        }
+        long long middle = now_ns();
+        for (j = 0; j < BENCH_BATCH; j++)
+        {
+            missed += shared_remove(&index,
+                                    extra[j]->product_id) != 0;
+        }
+        if (i >= 0)
+        {
+            samples[i]  = (double) (middle - start) / BENCH_BATCH;
+            removals[i] = (double) (now_ns() - middle) / BENCH_BATCH;
+        }
+    }
+    struct index_version *version = atomic_load(&index.version);
+    missed += version->count != count || node_size(version->root_product_id) != count ||
+              node_size(version->root_process_time) != count;
+    print_bench("shared",
+                "insert",
+                count,
+                samples,
+                BENCH_SAMPLES);
+    print_bench("shared",
+                "delete",
+                count,
+                removals,
+                BENCH_SAMPLES);
+    
+    if (missed > 0)
+    {
+        fprintf(stderr,
+                "[WARNING] shared: %ld checks failed\n",
+                missed);
+    }
+    
+    shared_free(&index);
+    free(by_product_id);
+    free(by_process_time);
+    
+    return 0;
+}
+
+/* The function times a sorted list of the given type built over count articles, extra holds BENCH_BATCH articles
+ * to insert and delete. It returns 0 on success, -1 if memory allocation fails */
+int bench_list(struct article **items,
+               int count,
+               struct article **extra,
+               int type)
+{
+    const char         *engine     = type == TYPE_PRODUCT_ID ? "list_id" : "list_time";
+    struct article     **sorted    = (struct article **) malloc(count * sizeof(struct article *));
+    int                iterations  = count >= 10000000 ? 3 : 10;
+    struct memory_pool pool;
+    struct sorted_list list;
+    double             samples[BENCH_SAMPLES], removals[BENCH_SAMPLES];
+    int                picks[BENCH_BATCH];
+    long               missed      = 0;
+    long long          start;
+    int                i, j, k;
+    
+    if (sorted == NULL)
+    {
+        printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+        return -1;
+    }
+    pool_init(&pool,
+              sizeof(struct list_chunk));
+    list_init(&list,
+              type);
+    
+    /* Loading: sorting the articles and filling the chunks, the first iteration is a warmup */
+    for (i = -1; i < iterations; i++)
+    {
+        list_free(&list);
+        pool_destroy(&pool);
+        memcpy(sorted,
+               items,
+               count * sizeof(struct article *));
+        start = now_ns();
+        if ((type == TYPE_PROCESS_TIME && sort_articles(sorted,
+                                                        count,
+                                                        TYPE_PRODUCT_ID) != 0) || sort_articles(sorted,
+                                                                                                count,
+                                                                                                type) != 0 || build_list(&pool,
+                                                                                                                         &list,
+                                                                                                                         sorted,
+                                                                                                                         count) != 0)
+        {
+            list_free(&list);
+            pool_destroy(&pool);
+            free(sorted);
+            return -1;
+        }
+        if (i >= 0)
+        {
+            samples[i] = (double) (now_ns() - start) / count;
+        }
+    }
+    print_bench(engine,
+                "load",
+                count,
+                samples,
+                iterations);
+    
+    /* Point lookup of random loaded articles: a binary search on the chunks, then one inside the chunk */
+    for (i = -BENCH_WARMUP; i < BENCH_SAMPLES; i++)
+    {
+        for (j = 0; j < BENCH_BATCH; j++)
+        {
+            picks[j] = rand() % count;
+        }
+        start = now_ns();
+        for (j = 0; j < BENCH_BATCH; j++)
+        {
+            struct article *item = items[picks[j]];
+            if (type == TYPE_PRODUCT_ID)
+            {
+                missed += search_in_list(&list,
+                                         item->product_id) != item;
+            }
+            else
+            {
+                struct list_chunk *chunk   = list.chunks[list_find_chunk(&list,
+                                                                         item)];
+                int               position = chunk_lower_bound(chunk,
+                                                               item,
+                                                               type);
+                missed += position == chunk->count || chunk->items[position] != item;
+            }
+        }
+        if (i >= 0)
+        {
+            samples[i] = (double) (now_ns() - start) / BENCH_BATCH;
+        }
+    }
+    print_bench(engine,
+                "lookup",
+                count,
+                samples,
+                BENCH_SAMPLES);
+    
+    /* Insert and delete of the same batch of articles, so the list keeps its size */
+    for (i = -BENCH_WARMUP; i < BENCH_SAMPLES; i++)
+    {
+        start = now_ns();
+        for (j = 0; j < BENCH_BATCH; j++)
+        {
+            if (insert_in_list(&pool,
+                               &list,
+                               extra[j]) != 0)
+            {
+                list_free(&list);
+                pool_destroy(&pool);
+                free(sorted);
+                return -1;
+            }
+        }
+        long long middle = now_ns();
+        for (j = 0; j < BENCH_BATCH; j++)
+        {
+            remove_list_item(&pool,
+                             &list,
+                             extra[j]);
+        }
+        if (i >= 0)
+        {
+            samples[i]  = (double) (middle - start) / BENCH_BATCH;
+            removals[i] = (double) (now_ns() - middle) / BENCH_BATCH;
+        }
+    }
+    missed += list.count != count;
+    print_bench(engine,
+                "insert",
+                count,
+                samples,
+                BENCH_SAMPLES);
+    print_bench(engine,
+                "delete",
+                count,
+                removals,
+                BENCH_SAMPLES);
+    
+    /* In-order scan of the whole list, chunk after chunk */
+    for (i = -1; i < iterations; i++)
+    {
+        long visited = 0;
+        start = now_ns();
+        for (j = 0; j < list.chunk_count; j++)
+        {
+            struct list_chunk *chunk = list.chunks[j];
+            for (k = 0; k < chunk->count; k++)
+            {
+                visited += chunk->items[k]->process_time >= 0;
+            }
+        }
+        if (i >= 0)
+        {
+            samples[i] = (double) (now_ns() - start) / count;
+        }
+        missed += visited != count;
+    }
+    print_bench(engine,
+                "scan",
+                count,
+                samples,
+                iterations);
+    
+    /* Range queries on the process time, each one returns BENCH_RANGE_ITEMS articles on average */
+    if (type == TYPE_PROCESS_TIME)
+    {
+        int32_t width = (int32_t) ((long long) BENCH_RANGE_ITEMS * SECONDS_PER_DAY / count);
+        long    returned = 0;
+        
+        for (i = -BENCH_WARMUP; i < BENCH_SAMPLES; i++)
+        {
+            for (j = 0; j < BENCH_RANGES; j++)
+            {
+                picks[j] = rand() % SECONDS_PER_DAY;
+            }
+            start = now_ns();
+            for (j = 0; j < BENCH_RANGES; j++)
+            {
+                struct article key;
+                int            chunk;
+                key.process_time = picks[j];
+                key.product_id   = 0;
+                chunk = list_find_chunk(&list,
+                                        &key);
+                for (k = chunk_lower_bound(list.chunks[chunk],
+                                           &key,
+                                           TYPE_PROCESS_TIME); chunk < list.chunk_count; chunk++, k = 0)
+                {
+                    while (k < list.chunks[chunk]->count && list.chunks[chunk]->items[k]->process_time <= picks[j] + width)
+                    {
+                        returned++;
+                        k++;
+                    }
+                    if (k < list.chunks[chunk]->count)
+                    {
+                        break;
+                    }
+                }
+            }
+            if (i >= 0)
+            {
+                samples[i] = (double) (now_ns() - start) / BENCH_RANGES;
+            }
+        }
+        bench_sink += returned;
+        print_bench(engine,
+                    "range",
+                    count,
+                    samples,
+                    BENCH_SAMPLES);
+    }
+    
+    if (missed > 0)
+    {
+        fprintf(stderr,
+                "[WARNING] %s: %ld checks failed\n",
+                engine,
+                missed);
+    }
+    
+    list_free(&list);
+    pool_destroy(&pool);
+    free(sorted);
+    
+    return 0;
+}
+
+/* The function times the hash table of the product ids built over count articles, extra holds BENCH_BATCH articles
+ * to insert and delete. It has no order, so it has no scan and no range query.
+ * It returns 0 on success, -1 if memory allocation fails */
+int bench_hash(struct article **items,
+               int count,
+               struct article **extra)
+{
+    struct hash_table table;
+    double            samples[BENCH_SAMPLES], removals[BENCH_SAMPLES];
+    int               picks[BENCH_BATCH];
+    int               iterations = count >= 10000000 ? 3 : 10;
+    long              missed     = 0;
+    long long         start;
+    int               i, j;
+    
+    table.entries = NULL;
+    
+    /* Loading: inserting every article in a table that grows from 16 entries, the first iteration is a warmup */
+    for (i = -1; i < iterations; i++)
+    {
+        free(table.entries);
+        start = now_ns();
+        if (hash_init(&table,
+                      16) != 0)
+        {
+            return -1;
+        }
+        for (j = 0; j < count; j++)
+        {
+            if (hash_insert(&table,
+                            items[j]) != 0)
+            {
+                hash_free(&table);
+                return -1;
+            }
+        }
+        if (i >= 0)
+        {
+            samples[i] = (double) (now_ns() - start) / count;
+        }
+    }
+    print_bench("hash",
+                "load",
+                count,
+                samples,
+                iterations);
+    
+    for (i = -BENCH_WARMUP; i < BENCH_SAMPLES; i++)
+    {
+        for (j = 0; j < BENCH_BATCH; j++)
+        {
+            picks[j] = rand() % count;
+        }
+        start = now_ns();
+        for (j = 0; j < BENCH_BATCH; j++)
+        {
+            struct hash_entry *entry = hash_search(&table,
+                                                   items[picks[j]]->product_id);
+            missed += entry == NULL || entry->item != items[picks[j]];
+        }
+        if (i >= 0)
+        {
+            samples[i] = (double) (now_ns() - start) / BENCH_BATCH;
+        }
+    }
+    print_bench("hash",
+                "lookup",
+                count,
+                samples,
+                BENCH_SAMPLES);
+    
+    for (i = -BENCH_WARMUP; i < BENCH_SAMPLES; i++)
+    {
+        start = now_ns();
+        for (j = 0; j < BENCH_BATCH; j++)
+        {
+            if (hash_insert(&table,
+                            extra[j]) != 0)
+            {
+                hash_free(&table);
+                return -1;
+            }
+        }
+        long long middle = now_ns();
+        for (j = 0; j < BENCH_BATCH; j++)
+        {
+            hash_remove(&table,
+                        hash_search(&table,
+                                    extra[j]->product_id));
+        }
+        if (i >= 0)
+        {
+            samples[i]  = (double) (middle - start) / BENCH_BATCH;
+            removals[i] = (double) (now_ns() - middle) / BENCH_BATCH;
+        }
+    }
+    missed += table.count != count;
+    print_bench("hash",
+                "insert",
+                count,
+                samples,
+                BENCH_SAMPLES);
+    print_bench("hash",
+                "delete",
+                count,
+                removals,
+                BENCH_SAMPLES);
+    
+    if (missed > 0)
+    {
+        fprintf(stderr,
+                "[WARNING] hash: %ld checks failed\n",
+                missed);
+    }
+    
+    hash_free(&table);
+    
+    return 0;
+}
+
+/* The function returns the time of a monotonic clock in nanoseconds: unlike clock(), it measures elapsed time */
+long long now_ns()
+{
+    struct timespec time;
+    
+    clock_gettime(CLOCK_MONOTONIC,
+                  &time);
+    
+    return (long long) time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+/* Comparison of two samples for qsort() */
+int compare_samples(const void *a,
+                    const void *b)
+{
+    double first  = *(const double *) a;
+    double second = *(const double *) b;
+    
+    return (first > second) - (first < second);
+}
+
+/* The function acquires the samples of an operation in nanoseconds per operation, sorts them and prints
+ * their minimum, nearest-rank percentiles, mean and the operations per second of the mean */
+void print_bench(const char *engine,
+                 const char *operation,
+                 int rows,
+                 double *samples,
+                 int count)
+{
+    double mean = 0;
+    int    i;
+    
+    qsort(samples,
+          count,
+          sizeof(double),
+          compare_samples);
+    for (i = 0; i < count; i++)
+    {
+        mean += samples[i] / count;
+    }
+    
+#define BENCH_PERCENTILE(fraction) samples[nearest_rank(fraction, count) - 1]
+    if (output.format == FORMAT_COLUMNS)
+    {
+        printf("%-12s%-10s%12d%9d%12.1f%12.1f%12.1f%12.1f%12.1f%14.0f\n",
+               engine,
+               operation,
+               rows,
+               count,
+               samples[0],
+               BENCH_PERCENTILE(0.5),
+               BENCH_PERCENTILE(0.9),
+               BENCH_PERCENTILE(0.99),
+               mean,
+               mean > 0 ? 1e9 / mean : 0);
+    }
+    else
+    {
+        char separator = output.format == FORMAT_CSV ? ',' : '\t';
+        printf("%s%c%s%c%d%c%d%c%.1f%c%.1f%c%.1f%c%.1f%c%.1f%c%.0f\n",
+               engine,
+               separator,
+               operation,
+               separator,
+               rows,
+               separator,
+               count,
+               separator,
+               samples[0],
+               separator,
+               BENCH_PERCENTILE(0.5),
+               separator,
+               BENCH_PERCENTILE(0.9),
+               separator,
+               BENCH_PERCENTILE(0.99),
+               separator,
+               mean,
+               separator,
+               mean > 0 ? 1e9 / mean : 0);
+    }
+#undef BENCH_PERCENTILE
+}
+
+/* Stress test functions */
+
+/* The function loads a data set with the given number of articles, then runs rounds of STRESS_SECONDS
+ * with one writer, which keeps inserting and removing articles through the same calls as the menu and the batch
+ * commands, and 1, 2, 4... readers up to max_readers, which enter the shared trees of the data set and
+ * look up the loaded articles and scan ranges of process times. Every round prints the reads per second
+ * (in total and per reader), their speedup on the first round and the writes per second, and at the end the trees
+ * are checked. In ENABLE_STATS builds every thread adds its counters to the total when it returns */
+void run_stress(long rows,
+                int max_readers)
+{
+    struct data_set data;
+    struct article  **by_product_id   = (struct article **) malloc((rows + 1) * sizeof(struct article *));
+    struct article  **by_process_time = (struct article **) malloc((rows + 1) * sizeof(struct article *));
+    double          first_reads       = 0;
+    long            errors            = 0;
+    int             count             = (int) rows;
+    int             readers           = 1;
+    int             failed            = 0;
+    int             i;
+    
+    if (max_readers > SHARED_MAX_READERS)
+    {
+        max_readers = SHARED_MAX_READERS;
+    }
+    if (max_readers < 1)
+    {
+        max_readers = 1;
+    }
+    
+    failed = init_data_set(&data) != 0;
+    if (by_product_id == NULL || by_process_time == NULL)
+    {
+        printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+        free_data_set(&data);
+        free(by_product_id);
+        free(by_process_time);
+        return;
+    }
+    
+    /* Same articles as the benchmarks: scattered ids and random process times */
+    srand(1);
+    for (i = 0; i < count && !failed; i++)
+    {
+        struct article *item = (struct article *) pool_alloc(&data.articles);
+        if (item == NULL)
+        {
+            failed = 1;
+            break;
+        }
+        item->name         = "Stress";
+        item->name_length  = 6;
+        item->product_id   = (uint32_t) (i + 1) * 2654435761u;
+        item->piece_id     = item->product_id;
+        item->time_entry   = 0;
+        item->time_exit    = (uint32_t) (rand() % SECONDS_PER_DAY);
+        item->process_time = (int32_t) item->time_exit;
+        by_product_id[i]   = item;
+    }
+    
+    /* Sorting by product id first, the stable sort by process time keeps ties in product id order */
+    failed = failed || sort_articles(by_product_id,
+                                     count,
+                                     TYPE_PRODUCT_ID) != 0;
+    if (!failed)
+    {
+        memcpy(by_process_time,
+               by_product_id,
+               count * sizeof(struct article *));
+    }
+    failed = failed || sort_articles(by_process_time,
+                                     count,
+                                     TYPE_PROCESS_TIME) != 0 || bulk_load(&data,
+                                                                          by_product_id,
+                                                                          by_process_time,
+                                                                          count) != 0;
+    
+    if (!failed)
+    {
+        if (output.format == FORMAT_COLUMNS)
+        {
+            printf("%8s%12s%10s%14s%14s%10s%14s%8s\n",
+                   "readers",
+                   "rows",
+                   "seconds",
+                   "reads_per_s",
+                   "per_reader_s",
+                   "speedup",
+                   "writes_per_s",
+                   "errors");
+        }
+        else
+        {
+            const char *fields[] = {"readers", "rows", "seconds", "reads_per_s", "per_reader_s", "speedup", "writes_per_s", "errors"};
+            for (i = 0; i < 8; i++)
+            {
+                printf("%s%c",
+                       fields[i],
+                       i == 7 ? '\n' : output.format == FORMAT_CSV ? ',' : '\t');
+            }
+        }
+    }
+    
+    while (!failed)
+    {
+        double reads_per_second, writes_per_second;
+        long   round_errors = 0;
+        
+        failed = stress_round(&data,
+                              by_product_id,
+                              count,
+                              readers,
+                              &reads_per_second,
+                              &writes_per_second,
+                              &round_errors) != 0;
+        if (failed)
+        {
+            break;
+        }
+        if (readers == 1)
+        {
+            first_reads = reads_per_second;
+        }
+        errors += round_errors;
+        
+        double speedup = first_reads > 0 ? reads_per_second / first_reads : 0;
+        if (output.format == FORMAT_COLUMNS)
+        {
+            printf("%8d%12d%10d%14.0f%14.0f%10.2f%14.0f%8ld\n",
+                   readers,
+                   count,
+                   STRESS_SECONDS,
+                   reads_per_second,
+                   reads_per_second / readers,
+                   speedup,
+                   writes_per_second,
+                   round_errors);
+        }
+        else
+        {
+            char separator = output.format == FORMAT_CSV ? ',' : '\t';
+            printf("%d%c%d%c%d%c%.0f%c%.0f%c%.2f%c%.0f%c%ld\n",
+                   readers,
+                   separator,
+                   count,
+                   separator,
+                   STRESS_SECONDS,
+                   separator,
+                   reads_per_second,
+                   separator,
+                   reads_per_second / readers,
+                   separator,
+                   speedup,
+                   separator,
+                   writes_per_second,
+                   separator,
+                   round_errors);
+        }
+        fflush(stdout);
+        
+        if (readers == max_readers)
+        {
+            break;
+        }
+        readers = readers * 2 < max_readers ? readers * 2 : max_readers;
+    }
+    
+    if (!failed)
+    {
+        errors += check_shared(&data.trees);
+        if (errors > 0)
+        {
+            fprintf(stderr,
+                    "[WARNING] Stress test: %ld errors\n",
+                    errors);
+        }
+    }
+    free_data_set(&data);
+    free(by_product_id);
+    free(by_process_time);
+}
+
+/* The function runs a round of the stress test: the writer and the given number of readers, for STRESS_SECONDS.
+ * It returns the reads and writes per second and the errors of the threads, and 0 on success,
+ * -1 if the threads can't be started */
+int stress_round(struct data_set *data,
+                 struct article **stable,
+                 int stable_count,
+                 int readers,
+                 double *reads_per_second,
+                 double *writes_per_second,
+                 long *errors)
+{
+    struct stress_thread threads[SHARED_MAX_READERS + 1];
+    pthread_t            thread_ids[SHARED_MAX_READERS + 1];
+    atomic_int           stop;
+    struct timespec      pause = {STRESS_SECONDS, 0};
+    long long            start, elapsed;
+    long                 reads = 0;
+    int                  started, i;
+    
+    atomic_init(&stop,
+                0);
+    
+    /* Thread 0 is the writer */
+    for (i = 0; i <= readers; i++)
+    {
+        threads[i].data         = data;
+        threads[i].stable       = stable;
+        threads[i].stable_count = stable_count;
+        threads[i].reader       = i - 1;
+        threads[i].seed         = 0x9E3779B97F4A7C15ULL * (i + 1);
+        threads[i].stop         = &stop;
+        threads[i].operations   = 0;
+        threads[i].errors       = 0;
+    }
+    
+    start = now_ns();
+    for (started = 0; started <= readers; started++)
+    {
+        if (pthread_create(&thread_ids[started],
+                           NULL,
+                           started == 0 ? stress_writer : stress_reader,
+                           &threads[started]) != 0)
+        {
+            break;
+        }
+    }
+    if (started > readers)
+    {
+        nanosleep(&pause,
+                  NULL);
+    }
+    elapsed = now_ns() - start;
+    atomic_store(&stop,
+                 1);
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(thread_ids[i],
+                     NULL);
+    }
+    
+    if (started <= readers)
+    {
+        printf("\n[ERROR] Thread creation failed, try to re-run the program\n");
+        return -1;
+    }
+    
+    for (i = 0; i <= readers; i++)
+    {
+        *errors += threads[i].errors;
+        if (i > 0)
+        {
+            reads += threads[i].operations;
+        }
+    }
+    *reads_per_second  = reads / (elapsed / 1e9);
+    *writes_per_second = threads[0].operations / (elapsed / 1e9);
+    
+    return 0;
+}
+
+/* Reader thread of the stress test: lookups of random loaded articles, and one range scan of STRESS_SCAN_ITEMS
+ * process times every 16 operations, each one on the version of the shared indexes it entered with */
+void *stress_reader(void *argument)
+{
+    struct stress_thread *thread = (struct stress_thread *) argument;
+    uint64_t             seed    = thread->seed;
+    
+    while (!atomic_load_explicit(thread->stop,
+                                 memory_order_relaxed))
+    {
+        struct index_version *version = reader_enter(&thread->data->trees,
+                                                     thread->reader);
+        
+        /* xorshift64 */
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        
+        if (thread->operations % 16 == 15)
+        {
+            struct article     key, *previous = NULL, *item;
+            struct tree_cursor cursor;
+            int                visited;
+            
+            key.process_time = (int32_t) (seed % SECONDS_PER_DAY);
+            key.product_id   = 0;
+            cursor_seek(&cursor,
+                        version->root_process_time,
+                        &key,
+                        TYPE_PROCESS_TIME);
+            for (visited = 0; visited < STRESS_SCAN_ITEMS && (item = cursor_item(&cursor)) != NULL; visited++)
+            {
+                if (previous != NULL && compare_items(previous,
+                                                      item,
+                                                      TYPE_PROCESS_TIME) >= 0)
+                {
+                    thread->errors++;
+                }
+                previous = item;
+                cursor_next(&cursor);
+            }
+        }
+        else
+        {
+            struct article *expected = thread->stable[seed % thread->stable_count];
+            struct node    *found    = search_id(version->root_product_id,
+                                                 expected->product_id);
+            if (found == NULL || found->item != expected)
+            {
+                thread->errors++;
+            }
+        }
+        
+        reader_exit(&thread->data->trees,
+                    thread->reader);
+        thread->operations++;
+    }
+    
+    STAT_FLUSH();
+    return NULL;
+}
+
+/* Writer thread of the stress test: it inserts new articles in the data set and, once STRESS_WINDOW of them are in,
+ * removes the oldest one before every insertion. When the round ends it removes the ones left, so only the loaded
+ * articles stay. The main thread waits for the round meanwhile, so this is the only writer of the data set */
+void *stress_writer(void *argument)
+{
+    struct stress_thread *thread = (struct stress_thread *) argument;
+    struct data_set      *data   = thread->data;
+    struct article       *window[STRESS_WINDOW];
+    uint64_t             seed    = thread->seed;
+    long                 serial  = 0;
+    int                  first   = 0, live = 0;
+    
+    while (thread->errors == 0 && (live > 0 || !atomic_load_explicit(thread->stop,
+                                                                      memory_order_relaxed)))
+    {
+        if (live == STRESS_WINDOW || atomic_load_explicit(thread->stop,
+                                                          memory_order_relaxed))
+        {
+            remove_article(data,
+                           window[first]);
+            first = (first + 1) % STRESS_WINDOW;
+            live--;
+            thread->operations++;
+            continue;
+        }
+        
+        struct article *item = (struct article *) pool_alloc(&data->articles);
+        if (item == NULL)
+        {
+            thread->errors++;
+            break;
+        }
+        
+        /* At most STRESS_WINDOW articles are in, so 2 * STRESS_WINDOW ids are enough */
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        item->name         = "Stress";
+        item->name_length  = 6;
+        item->product_id   = (uint32_t) (thread->stable_count + 1 + serial++ % (2 * STRESS_WINDOW)) * 2654435761u;
+        item->piece_id     = item->product_id;
+        item->time_entry   = 0;
+        item->time_exit    = (uint32_t) (seed % SECONDS_PER_DAY);
+        item->process_time = (int32_t) item->time_exit;
+        
+        if (insert_article(data,
+                           item) != 0)
+        {
+            thread->errors++;
+            break;
+        }
+        window[(first + live++) % STRESS_WINDOW] = item;
+        thread->operations++;
+    }
+    
+    STAT_FLUSH();
+    return NULL;
+}
+
+/* The function checks the current version of the shared indexes, with no thread running: both trees hold
+ * as many articles as the version, in strictly increasing order. It returns the number of errors */
+int check_shared(struct shared_index *index)
+{
+    struct index_version *version = atomic_load(&index->version);
+    struct tree_cursor   cursor;
+    long                 errors   = 0;
+    int                  type;
+    
+    for (type = TYPE_PRODUCT_ID; type <= TYPE_PROCESS_TIME; type++)
+    {
+        struct node    *root     = type == TYPE_PRODUCT_ID ? version->root_product_id : version->root_process_time;
+        struct article *previous = NULL, *item;
+        int            count     = 0;
+        
+        for (cursor_first(&cursor,
+                          root); (item = cursor_item(&cursor)) != NULL; cursor_next(&cursor))
+        {
+            if (previous != NULL && compare_items(previous,
+                                                  item,
+                                                  type) >= 0)
+            {
+                errors++;
+            }
+            previous = item;
+            count++;
+        }
+        if (count != version->count || node_size(root) != version->count)
+        {
+            errors++;
+        }
+    }
+    
+    return (int) errors;
+}
+
+
+/* Batch functions */
+
+/* The function acquires a file of commands ("-" for stdin) and runs them one after another on the data set,
+ * without prompts. Empty lines and lines starting with # are skipped, invalid commands are reported on stderr.
+ * It returns the number of commands run, -1 if the file can't be opened */
+long run_batch(const char *file,
+               struct data_set *data)
+{
+    FILE    *f       = strcmp(file,
+                              "-") == 0 ? stdin : fopen(file,
+                                                        "r");
+    char    *line    = NULL;
+    size_t  size     = 0;
+    ssize_t length;
+    long    line_number = 0, commands = 0;
     
-    /* Set on entry time and exit time, day, month and current year, in order to make a correct evaluation. */
-    tm_entry.tm_mday = tm_exit.tm_mday = tm_today->tm_mday;
-    tm_entry.tm_mon  = tm_exit.tm_mon  = tm_today->tm_mon;
-    tm_entry.tm_year = tm_exit.tm_year = tm_today->tm_year;
+    if (f == NULL)
+    {
+        return -1;
+    }
     
-    /* Convert the entry time and the exit time from the struct tm format to the suitable type
-     * for storing the calendar format (time_t) in order to calculate the process time. */
-    t_entry = mktime(&tm_entry);
-    t_exit  = mktime(&tm_exit);
+    while ((length = getline(&line,
+                             &size,
+                             f)) >= 0)
+    {
+        line_number++;
+        
+        /* Removing the line terminator */
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+        {
+            line[--length] = '\0';
+        }
+        
+        const char *start = line + strspn(line,
+                                          " \t");
+        if (*start == '\0' || *start == '#')
+        {
+            continue;
+        }
+        
+        const char *error = run_command(data,
+                                        line,
+                                        length);
+        if (error != NULL)
+        {
+            fprintf(stderr,
+                    "[WARNING] Command %ld: %s, skipped\n",
+                    line_number,
+                    error);
+        }
+        commands++;
+        log_checkpoint(data);
+    }
     
-    /* Calculate de time difference in seconds between time exit and time entry. */
-    diff_t = difftime(t_exit,
-                      t_entry);
+    log_commit(data);
     
-    return (diff_t);
+    free(line);
+    if (f != stdin)
+    {
+        fclose(f);
+    }
+    fflush(stdout);
+    
+    return commands;
 }
 
+/* The function acquires a command line (null terminated, of the given length) and runs it on the data set.
+ * It returns NULL on success, otherwise a message that describes the error */
+const char *run_command(struct data_set *data,
+                        char *line,
+                        size_t length)
+{
+    char command[16], argument[64], extra[64];
+    int  offset = 0;
+    
+    if (sscanf(line,
+               "%15s %n",
+               command,
+               &offset) != 1)
+    {
+        return "empty command";
+    }
+    
+    char *arguments = line + offset;
+    int  count      = sscanf(arguments,
+                             "%63s %63s",
+                             argument,
+                             extra);
+    
+    if (count < 0)
+    {
+        count = 0;
+    }
+    
+    if (strcmp(command,
+               "insert") == 0)
+    {
+        /* The arguments are a row of the input file */
+        struct record record;
+        const char    *error = parse_record(arguments,
+                                           line + length,
+                                           &record);
+        if (error != NULL)
+        {
+            return error;
+        }
+        if (hash_search(&data->ids,
+                        record.product_id) != NULL)
+        {
+            return "duplicate product id";
+        }
+        
+        struct article *item = new_article(&data->articles,
+                                           &data->names,
+                                           record.product_id,
+                                           record.name,
+                                           record.name_length,
+                                           record.piece_id,
+                                           record.time_entry,
+                                           record.time_exit,
+                                           record.process_time);
+        if (item != NULL && log_append(data,
+                                       LOG_INSERT,
+                                       item,
+                                       0) != 0)
+        {
+            pool_release(&data->articles,
+                         item);
+            return "log write failed";
+        }
+        if (item == NULL || insert_article(data,
+                                           item) != 0)
+        {
+            return "memory allocation failed";
+        }
+    }
+    else if (strcmp(command,
+                    "remove") == 0 || strcmp(command,
+                                             "find") == 0 || strcmp(command,
+                                                                    "rank") == 0)
+    {
+        struct hash_entry *entry = NULL;
+        if (count >= 1 && strlen(argument) == ID_LENGTH)
+        {
+            entry = hash_search(&data->ids,
+                                pack_id(argument));
+        }
+        if (entry == NULL)
+        {
+            return "product id does not exist";
+        }
+        
+        if (command[0] == 'r' && command[1] == 'e')
+        {
+            if (log_append(data,
+                           LOG_REMOVE,
+                           entry->item,
+                           0) != 0)
+            {
+                return "log write failed";
+            }
+            remove_article(data,
+                           entry->item);
+        }
+        else if (command[0] == 'f')
+        {
+            print_article(entry->item);
+        }
+        else
+        {
+            printf("%s %d %d %d\n",
+                   argument,
+                   entry->item->process_time,
+                   rank_of(data->root_process_time,
+                           entry->item,
+                           TYPE_PROCESS_TIME) + 1,
+                   node_size(data->root_process_time));
+        }
+    }
+    else if (strcmp(command,
+                    "dump") == 0)
+    {
+        if (output.format != FORMAT_COLUMNS)
+        {
+            print_header();
+        }
+        if (count >= 1 && strcmp(argument,
+                                 "--sort=time") == 0)
+        {
+            print_tree(data->root_process_time);
+        }
+        else if (count == 0 || strcmp(argument,
+                                      "--sort=id") == 0)
+        {
+            print_tree(data->root_product_id);
+        }
+        else
+        {
+            return "sort key must be id or time";
+        }
+    }
+    else if (strcmp(command,
+                    "slowest") == 0)
+    {
+        int remaining;
+        if (count < 1 || sscanf(argument,
+                                "%d",
+                                &remaining) != 1)
+        {
+            return "missing number of items";
+        }
+        print_slowest(data->root_process_time,
+                      &remaining);
+    }
+    else if (strcmp(command,
+                    "range") == 0)
+    {
+        int low, high;
+        if (sscanf(arguments,
+                   "%d %d",
+                   &low,
+                   &high) != 2)
+        {
+            return "missing range";
+        }
+        print_range(data->root_process_time,
+                    low,
+                    high);
+    }
+    else if (strcmp(command,
+                    "stats") == 0)
+    {
+        if (count >= 1 && strcmp(argument,
+                                 "ops") == 0)
+        {
+#ifdef ENABLE_STATS
+            print_op_stats();
+            if (count >= 2 && strcmp(extra,
+                                     "--reset") == 0)
+            {
+                reset_op_stats();
+            }
+#else
+            return "counters need a build with -DENABLE_STATS";
+#endif
+        }
+        else
+        {
+            print_statistics(data->root_process_time);
+        }
+    }
+    else if (strcmp(command,
+                    "apply") == 0)
+    {
+        if (count < 1 || apply_batch(data,
+                                     argument) < 0)
+        {
+            return "apply failed";
+        }
+    }
+    else if (strcmp(command,
+                    "save") == 0)
+    {
+        if (count < 1 || save_snapshot(data,
+                                       argument) < 0)
+        {
+            return "save failed";
+        }
+    }
+    else if (strcmp(command,
+                    "groups") == 0)
+    {
+        print_groups(&data->by_name,
+                     data->root_process_time);
+    }
+    else if (strcmp(command,
+                    "piece") == 0)
+    {
+        struct aggregate *group = NULL;
+        if (count >= 1 && strlen(argument) == ID_LENGTH)
+        {
+            struct article key;
+            key.piece_id = pack_id(argument);
+            group = group_find(&data->by_piece_id,
+                               &key,
+                               0);
+        }
+        if (group == NULL || group->count == 0)
+        {
+            return "piece id does not exist";
+        }
+        group_resolve(&data->by_piece_id,
+                      group,
+                      data->root_process_time);
+        print_aggregate(argument,
+                        ID_LENGTH,
+                        group);
+    }
+    else
+    {
+        return "unknown command";
+    }
+    
+    output_flush();
+    
+    return NULL;
+}
 
-/* General functions */
-
-/* The function acquires the root and print its data in a formatted way */
-void print_data(struct node *root)
+/* The function acquires the root of the process time tree and prints the number of items and the main percentiles */
+void print_statistics(struct node *root)
 {
-    printf("\n-------------------------------------------------------------------------------\n");
-    printf("%-15s%-20s%-15s%-20s%-20s\n",
-           "Product id",
-           "Name",
-           "Piece id",
-           "Time entry",
-           "Time exit");
-    printf("-------------------------------------------------------------------------------\n");
-    print_tree(root);
-    printf("-------------------------------------------------------------------------------\n");
+    printf("%-10s%d\n",
+           "Items",
+           node_size(root));
+    if (root == NULL)
+    {
+        return;
+    }
+    
+    printf("%-10s%d\n",
+           "Minimum",
+           percentile(root,
+                      0)->process_time);
+    printf("%-10s%d\n",
+           "Median",
+           percentile(root,
+                      0.5)->process_time);
+    printf("%-10s%d\n",
+           "p90",
+           percentile(root,
+                      0.9)->process_time);
+    printf("%-10s%d\n",
+           "p95",
+           percentile(root,
+                      0.95)->process_time);
+    printf("%-10s%d\n",
+           "p99",
+           percentile(root,
+                      0.99)->process_time);
+    printf("%-10s%d\n",
+           "Maximum",
+           percentile(root,
+                      1)->process_time);
 }
 
-/* Clear buffer function to avoid scanf errors */
-void clear_buffer()
+/* The function acquires the data set and a file of insert and remove commands (same syntax as the batch mode),
+ * and applies all of them at once. The hash table is updated command by command, so duplicates and missing
+ * product ids are found (and reported) in file order, and a row inserted and removed by the same file never reaches
+ * the indexes. Then the inserted and the removed articles are sorted by every key (radix sort) and merged with
+ * the current content of the lists, every tree and list is rebuilt from the merged arrays and the aggregates are
+ * updated: O(n + k) instead of k separate updates. It returns the number of applied commands, -1 on error */
+long apply_batch(struct data_set *data,
+                 const char *file)
 {
-    char c;
-    while ((c = getchar()) != '\n' && c != EOF);
+    FILE              *f       = fopen(file,
+                                       "r");
+    char              *line    = NULL;
+    size_t            size     = 0;
+    ssize_t           length;
+    long              line_number = 0, applied = 0;
+    struct article    **added  = NULL, **removed = NULL;
+    int               added_count = 0, removed_count = 0, capacity = 0;
+    struct hash_table batch_ids;           /* Articles inserted by this file, they are not in the indexes yet */
+    int               error    = 0;
+    
+    if (f == NULL || hash_init(&batch_ids,
+                               64) != 0)
+    {
+        if (f != NULL)
+        {
+            fclose(f);
+        }
+        return -1;
+    }
+    
+    while (!error && (length = getline(&line,
+                                       &size,
+                                       f)) >= 0)
+    {
+        line_number++;
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+        {
+            line[--length] = '\0';
+        }
+        
+        char command[16], argument[64];
+        int  offset = 0;
+        if (sscanf(line,
+                   "%15s %n",
+                   command,
+                   &offset) != 1 || command[0] == '#')
+        {
+            continue;
+        }
+        
+        /* Both arrays grow together, so there is always room for one more article in each one */
+        if (added_count == capacity || removed_count == capacity)
+        {
+            capacity = capacity == 0 ? 1024 : capacity * 2;
+            struct article **grown_added   = (struct article **) realloc(added,
+                                                                         capacity * sizeof(struct article *));
+            if (grown_added != NULL)
+            {
+                added = grown_added;
+            }
+            struct article **grown_removed = (struct article **) realloc(removed,
+                                                                         capacity * sizeof(struct article *));
+            if (grown_removed != NULL)
+            {
+                removed = grown_removed;
+            }
+            if (grown_added == NULL || grown_removed == NULL)
+            {
+                printf("\n[ERROR] Memory allocation failed, try to re-run the program\n");
+                error = 1;
+                break;
+            }
+        }
+        
+        const char *warning = NULL;
+        
+        if (strcmp(command,
+                   "insert") == 0)
+        {
+            struct record record;
+            if ((warning = parse_record(line + offset,
+                                        line + length,
+                                        &record)) == NULL)
+            {
+                if (hash_search(&data->ids,
+                                record.product_id) != NULL)
+                {
+                    warning = "duplicate product id";
+                }
+                else
+                {
+                    struct article *item = new_article(&data->articles,
+                                                       &data->names,
+                                                       record.product_id,
+                                                       record.name,
+                                                       record.name_length,
+                                                       record.piece_id,
+                                                       record.time_entry,
+                                                       record.time_exit,
+                                                       record.process_time);
+                    if (item != NULL && log_append(data,
+                                                   LOG_INSERT,
+                                                   item,
+                                                   0) != 0)
+                    {
+                        pool_release(&data->articles,
+                                     item);
+                        warning = "log write failed";
+                    }
+                    else if (item == NULL || hash_insert(&data->ids,
+                                                         item) != 0 || hash_insert(&batch_ids,
+                                                                                   item) != 0)
+                    {
+                        error = 1;
+                        break;
+                    }
+                    else
+                    {
+                        added[added_count++] = item;
+                    }
+                }
+            }
+        }
+        else if (strcmp(command,
+                        "remove") == 0)
+        {
+            struct hash_entry *entry = NULL;
+            if (sscanf(line + offset,
+                       "%63s",
+                       argument) == 1 && strlen(argument) == ID_LENGTH)
+            {
+                entry = hash_search(&data->ids,
+                                    pack_id(argument));
+            }
+            
+            if (entry == NULL)
+            {
+                warning = "product id does not exist";
+            }
+            else if (log_append(data,
+                                LOG_REMOVE,
+                                entry->item,
+                                0) != 0)
+            {
+                warning = "log write failed";
+            }
+            else
+            {
+                struct article    *item       = entry->item;
+                struct hash_entry *batch_entry = hash_search(&batch_ids,
+                                                            item->product_id);
+                hash_remove(&data->ids,
+                            entry);
+                
+                /* An article inserted by this file is only marked, it is released when the added ones are sorted */
+                if (batch_entry != NULL)
+                {
+                    hash_remove(&batch_ids,
+                                batch_entry);
+                    item->name = NULL;
+                }
+                else
+                {
+                    removed[removed_count++] = item;
+                }
+            }
+        }
+        else
+        {
+            warning = "only insert and remove can be applied";
+        }
+        
+        if (warning != NULL)
+        {
+            fprintf(stderr,
+                    "[WARNING] %s line %ld: %s, skipped\n",
+                    file,
+                    line_number,
+                    warning);
+        }
+        else
+        {
+            applied++;
+        }
+    }
+    
+    free(line);
+    fclose(f);
+    hash_free(&batch_ids);
+    
+    /* Dropping the articles inserted and removed by the file */
+    int i, j;
+    for (i = 0, j = 0; !error && i < added_count; i++)
+    {
+        if (added[i]->name == NULL)
+        {
+            pool_release(&data->articles,
+                         added[i]);
+        }
+        else
+        {
+            added[j++] = added[i];
+        }
+    }
+    added_count = j;
+    
+    int            old_count = data->list_product_id.count;
+    int            new_count = old_count + added_count - removed_count;
+    struct article **old     = NULL, **merged = NULL;
+    
+    if (!error && added_count + removed_count > 0)
+    {
+        old    = (struct article **) malloc((old_count + 1) * sizeof(struct article *));
+        merged = (struct article **) malloc((new_count + 1) * 2 * sizeof(struct article *));
+        error  = old == NULL || merged == NULL;
+    }
+    
+    if (!error && added_count + removed_count > 0)
+    {
+        struct article **merged_by_time = merged + new_count + 1;
+        
+        /* Sorting the changes by product id, then (stable) by process time, and merging them with every list */
+        error = sort_articles(added,
+                              added_count,
+                              TYPE_PRODUCT_ID) != 0 || sort_articles(removed,
+                                                                     removed_count,
+                                                                     TYPE_PRODUCT_ID) != 0;
+        if (!error)
+        {
+            list_to_array(&data->list_product_id,
+                          old);
+            merge_sorted(old,
+                         old_count,
+                         removed,
+                         removed_count,
+                         added,
+                         added_count,
+                         merged,
+                         TYPE_PRODUCT_ID);
+            
+            error = sort_articles(added,
+                                  added_count,
+                                  TYPE_PROCESS_TIME) != 0 || sort_articles(removed,
+                                                                           removed_count,
+                                                                           TYPE_PROCESS_TIME) != 0;
+        }
+        if (!error)
+        {
+            list_to_array(&data->list_process_time,
+                          old);
+            merge_sorted(old,
+                         old_count,
+                         removed,
+                         removed_count,
+                         added,
+                         added_count,
+                         merged_by_time,
+                         TYPE_PROCESS_TIME);
+            
+            /* Rebuilding every tree and every list from the merged arrays. The trees are published as a new
+             * version, the removed articles are retired with the old one */
+            pool_destroy(&data->list_chunks);
+            list_free(&data->list_product_id);
+            list_free(&data->list_process_time);
+            
+            error = shared_build(&data->trees,
+                                 merged,
+                                 merged_by_time,
+                                 new_count,
+                                 removed,
+                                 removed_count) != 0;
+            update_roots(data);
+            error = error || build_list(&data->list_chunks,
+                                        &data->list_product_id,
+                                        merged,
+                                        new_count) != 0 || build_list(&data->list_chunks,
+                                                                      &data->list_process_time,
+                                                                      merged_by_time,
+                                                                      new_count) != 0;
+        }
+        
+        /* Updating the aggregates of the articles that reached or left the indexes */
+        for (i = 0; !error && i < added_count; i++)
+        {
+            error = aggregate_add(data,
+                                  added[i]) != 0;
+        }
+        for (i = 0; !error && i < removed_count; i++)
+        {
+            aggregate_remove(data,
+                             removed[i]);
+        }
+    }
+    
+    free(old);
+    free(merged);
+    free(added);
+    free(removed);
+    
+    data->count    = data->ids.count;
+    data->changes += added_count + removed_count;
+    
+    if (!error)
+    {
+        printf("Applied %ld commands: %d inserted, %d removed, %d records\n",
+               applied,
+               added_count,
+               removed_count,
+               data->count);
+    }
+    
+    return error ? -1 : applied;
 }
 
-int get_valid_int(char *field_name)
+/* The function acquires the articles of an index in order, the ones to remove from it and the ones to add to it
+ * (both sorted in the same order), and writes the new content of the index in merged, in a single pass.
+ * It returns the number of merged articles */
+int merge_sorted(struct article **old,
+                 int old_count,
+                 struct article **removed,
+                 int removed_count,
+                 struct article **added,
+                 int added_count,
+                 struct article **merged,
+                 int type)
 {
-    int  is_valid = 0;
-    int  value;
-    char term;
-    while (!is_valid)
+    int i = 0, r = 0, a = 0, count = 0;
+    
+    while (i < old_count || a < added_count)
     {
-        if (scanf("%d%c",
-                  &value,
-                  &term) != 2 || term != '\n')
+        /* The removed articles are found in the same order as they are in the index */
+        if (i < old_count && r < removed_count && old[i] == removed[r])
         {
-            clear_buffer();
-            printf("%s must be of type integer, try again: ",
-                   field_name);
+            i++;
+            r++;
+        }
+        else if (a == added_count || (i < old_count && compare_items(old[i],
+                                                                     added[a],
+                                                                     type) < 0))
+        {
+            merged[count++] = old[i++];
         }
         else
         {
-            is_valid = 1;
+            merged[count++] = added[a++];
         }
     }
     
-    return value;
+    return count;
 }
@@ -1,70 +1,523 @@
+/*
+*     DATA GENERATOR
+*     It writes an input file for assembly_line_management, and optionally a trace of commands in the format of
+*     its --batch mode, to replay against the generated file.
+*
+*     BUILD: gcc -O2 -o data_generator data_generator.c
+*
+*     USAGE: data_generator [options]
+*       -n ROWS            rows to write (default 50)
+*       -s SEED            seed of the random generator, the same seed gives the same files (default 1)
+*       -o FILE            input file to write, "-" for stdout (default input.txt)
+*       --ids dense|sparse product ids next to each other, or spread over the whole id space (default dense)
+*       --order sorted|reverse|random
+*                          order of the rows by product id (default random)
+*       --same-duration R  ratio of rows whose duration is one of a few common values (default 0.1)
+*       --midnight R       ratio of rows crossing midnight, written with a sixth field of 1 day (default 0.05)
+*       --names N          different names (default 50)
+*       --pieces N         different piece ids (default 50)
+*       --trace FILE       command file to write, "-" for stdout
+*       --ops N            commands in the trace (default ROWS)
+*       --mix I:R:Q        percentages of insert, remove and query commands in the trace (default 40:30:30)
+*
+*     Product ids have 4 characters out of 62, so at most 62^4 rows have different ids:
+*     past that the ids start again from the first one, and the duplicated rows are skipped by the loader.
+*     Every id in the trace is valid when it is replayed: inserted ids are new, removed ids were loaded and never
+*     removed before. Queries (find, rank, range, slowest) may look for ids already removed.
+*/
+
 /* Including standard libraries */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 
 /* Definition of constants */
 #define INPUT_FILE "input.txt"
 #define ARRAY_LENGTH 50
 
-void clear_buffer();
-int get_valid_int(char *field_name);
+/* Characters of the ids and number of different ids */
+#define ID_LENGTH 4
+#define ID_CHARACTERS "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+#define ID_SPACE (62ULL * 62 * 62 * 62)
+
+/* Longest duration of a row in seconds, and seconds in a day */
+#define MAX_DURATION 14400
+#define SECONDS_PER_DAY 86400
+
+/* Size of the buffers where rows are formatted before being written */
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+/* Order of the rows and distribution of the ids */
+#define ORDER_SORTED 0
+#define ORDER_REVERSE 1
+#define ORDER_RANDOM 2
+#define IDS_DENSE 0
+#define IDS_SPARSE 1
+
+/* Output file with its buffer */
+struct output
+{
+	FILE   *file;
+	char   *data;
+	size_t used;
+};
+
+/* Permutation of the numbers from 0 to size - 1: a 4 round Feistel network over the smallest even number of bits
+ * covering size, walking the cycle again when the result is out of range. It needs no memory, and it is inverted
+ * by running the rounds backwards */
+struct permutation
+{
+	uint64_t size;
+	int      half_bits;
+	uint64_t keys[4];
+};
+
+/* Generator options */
+struct options
+{
+	unsigned long long rows;
+	unsigned long long seed;
+	const char         *file;
+	int                ids;
+	int                order;
+	double             same_duration;
+	double             midnight;
+	unsigned long      names;
+	unsigned long      pieces;
+	const char         *trace;
+	unsigned long long ops;
+	int                mix[3];
+};
+
+uint64_t next_random(uint64_t *state);
+uint64_t random_below(uint64_t *state, uint64_t bound);
+double random_ratio(uint64_t *state);
+
+void permutation_init(struct permutation *permutation, uint64_t size, uint64_t *state);
+uint64_t permute(struct permutation *permutation, uint64_t value);
+uint64_t unpermute(struct permutation *permutation, uint64_t value);
+
+int output_open(struct output *output, const char *file);
+char *output_reserve(struct output *output, size_t length);
+int output_close(struct output *output);
+
+char *write_id(char *out, uint64_t value);
+char *write_time(char *out, uint32_t seconds);
+char *write_number(char *out, unsigned long long value);
+char *write_name(char *out, unsigned long index);
+char *write_row(char *out, uint64_t id, const struct options *options, uint64_t *state);
+
+int parse_options(int argc, char *argv[], struct options *options);
+
+const char *names[ARRAY_LENGTH] = {"Screw", "Bolt", "Stud", "Nut", "Washer", "Rivet", "Insert", "Standoff", "Thread_insert", "Pin", "Locking_pin", "Clevis_pin", "Shim", "Spacer", "Hose_clamp", "Fixing_clip", "Cable_tie", "Toggle_clamp", "Spring_plunger", "Locating_pin", "Ball_plunger", "HingesHinge", "Lid_stay", "Lock", "Draw_latche", "Latche", "Strike_plate", "Locking_insert", "Cylinder_lock", "Locking_device", "SlidesSlide", "HandlesHandle", "Clamping_lever", "Knob", "Lever", "Handwheel", "Crank_handle", "PlugsPlug", "Cap", "SpringsSpring", "Air_spring", "Gas_spring", "Damper", "Shock_damper", "Stop", "Bumper", "Thrust_pad", "Rotary_damper", "Other_damper", "Wheel"};
 
-int main() {
+/* Durations shared by the rows with a common duration, in seconds */
+const uint32_t common_durations[] = {60, 120, 300, 600, 900, 1200, 1800, 2700, 3600, 5400, 7200, 10800};
 
-	/* Defining some constant values */
-	const char *products_ids[ARRAY_LENGTH] = {"MZXK", "CQA8", "VMMW", "TGK3", "9WYR", "SZ5I", "EWG4", "VJMJ", "KMU7", "O3EV", "CSUF", "KJD2", "6VF2", "JZ3E", "O81V", "FIBN", "1X2G", "P4UN", "GOA5", "3SMH", "H0WY", "DQUY", "CQIC", "U4VQ", "CUF4", "IJLM", "PZXQ", "58WE", "8WPD", "FZM6", "BCWZ", "EZV0", "88NX", "J12I", "U4G1", "NPUT", "01UX", "6KMP", "LCM5", "G9JN", "E1B0", "M386", "NJ1S", "BPUQ", "FLSZ", "5VWJ", "ENDV", "OEWD", "BRVP", "8O1D"};
-	const char *names[ARRAY_LENGTH] = {"Screw", "Bolt", "Stud", "Nut", "Washer", "Rivet", "Insert", "Standoff", "Thread_insert", "Pin", "Locking_pin", "Clevis_pin", "Shim", "Spacer", "Hose_clamp", "Fixing_clip", "Cable_tie", "Toggle_clamp", "Spring_plunger", "Locating_pin", "Ball_plunger", "HingesHinge", "Lid_stay", "Lock", "Draw_latche", "Latche", "Strike_plate", "Locking_insert", "Cylinder_lock", "Locking_device", "SlidesSlide", "HandlesHandle", "Clamping_lever", "Knob", "Lever", "Handwheel", "Crank_handle", "PlugsPlug", "Cap", "SpringsSpring", "Air_spring", "Gas_spring", "Damper", "Shock_damper", "Stop", "Bumper", "Thrust_pad", "Rotary_damper", "Other_damper", "Wheel"};
-	const char *pieces_ids[ARRAY_LENGTH] = {"FP8K", "07HA", "ZWDI", "XUNF", "FEH4", "7RM1", "CRUX", "8DJC", "TDNR", "OWP9", "OKJ8", "69NI", "C2Q0", "31R1", "P57B", "79Y9", "ZU78", "EN1E", "CWTD", "4VOS", "1A97", "SMWR", "W3PF", "ZGO3", "VMU7", "OS34", "6EKY", "8F5F", "Z97I", "PP78", "4KKD", "1LV6", "OYKH", "9P1V", "B8H0", "V4CQ", "MFBV", "FS9O", "COFX", "HIMV", "RHAK", "DUBL", "3OD6", "03GQ", "MDBV", "49VM", "JW06", "AGPB", "G1DJ", "L637"};
-	const char *times_entry[ARRAY_LENGTH] = {"17:23:05","21:16:56","15:06:49","14:25:11","00:05:15","02:44:29","20:06:48","08:12:56","00:49:27","20:15:39","06:11:57","00:15:44","03:32:07","05:39:18","01:14:21","21:07:49","13:34:09","01:47:35","02:17:06","01:51:00","13:13:48","21:46:30","16:26:28","05:50:57","00:23:23","02:12:03","00:32:44","13:23:11","06:02:36","19:46:17","16:59:08","11:26:24","18:03:26","01:55:09","16:33:28","07:23:21","21:08:15","03:14:06","22:14:34","17:17:41","13:45:10","23:38:31","09:06:38","04:10:19","12:30:05","23:23:16","11:35:10","03:38:13","12:55:01","18:35:16"};
-	const char *times_exit[ARRAY_LENGTH] = {"18:14:24","22:48:55","16:18:57","15:32:32","01:13:16","17:12:56","20:24:35","08:44:10","01:54:08","21:55:43","06:41:28","01:19:12","15:08:36","06:26:36","06:54:04","23:29:03","20:42:53","06:54:04","05:11:44","02:23:52","15:01:50","22:12:20","21:49:39","09:25:50","05:11:44","10:52:56","00:32:49","13:55:21","07:16:15","20:14:13","18:45:35","12:44:01","19:44:34","02:22:50","17:05:43","08:49:21","23:13:51","05:45:55","23:11:57","17:42:58","15:11:01","23:49:00","11:12:15","05:26:05","15:52:40","23:59:59","13:30:00","05:39:13","15:38:11","19:20:12"};
+int main(int argc, char *argv[]) {
 
-	int i = 0;
+	struct options     options;
+	struct permutation slots, removals;
+	struct output      output;
+	uint64_t           state, total, inserts = 0, removes = 0, stride = 1;
+	unsigned long long i;
 
-	int max;
-	printf("\nInsert number of articles to generate (0-50): ");
-	max = get_valid_int("Num articles to generate");
+	if (parse_options(argc, argv, &options) != 0) {
+		return 1;
+	}
+	state = options.seed;
+
+	/* Every row of the file and every inserted row of the trace takes a slot, and each slot is a different id.
+	 * A slot belongs to the file when its permuted value is lower than the number of rows, so the inserted ids fall
+	 * between the loaded ones whatever the order of the file is */
+	if (options.trace != NULL) {
+		inserts = options.ops * options.mix[0] / 100;
+		removes = options.ops * options.mix[1] / 100;
+		if (removes > options.rows) {
+			fprintf(stderr, "The trace can't remove more than the %llu loaded rows\n", options.rows);
+			return 1;
+		}
+	}
+	total = options.rows + inserts;
+	if (total > ID_SPACE) {
+		fprintf(stderr, "[WARNING] Only %llu different product ids, the ids of the following rows are repeated\n", ID_SPACE);
+	} else if (options.ids == IDS_SPARSE && total > 0) {
+		stride = ID_SPACE / total;
+	}
+	permutation_init(&slots, total, &state);
+	permutation_init(&removals, options.rows, &state);
 
-	FILE *f = fopen(INPUT_FILE, "w");
-	if (f != NULL)
-	{
-		/* Loop until max value */
-		for (i = 0; i < max; i++) {
-			fprintf(f, "%s %s %s %s %s\n", products_ids[i], names[i], pieces_ids[i], times_entry[i], times_exit[i]); /* Writing to file */
+	/* Writing the input file */
+	if (output_open(&output, options.file) != 0) {
+		return 1;
+	}
+	if (options.order == ORDER_RANDOM) {
+		for (i = 0; i < options.rows; i++) {
+			char *row = output_reserve(&output, 128);
+			output.used += write_row(row, unpermute(&slots, i) * stride, &options, &state) - row;
 		}
-		fclose(f);
 	} else {
-		printf("Error opening file!\n");
+		/* Walking every slot in order, and keeping the ones of the file */
+		for (i = 0; i < total; i++) {
+			uint64_t slot = options.order == ORDER_SORTED ? i : total - 1 - i;
+			if (inserts == 0 || permute(&slots, slot) < options.rows) {
+				char *row = output_reserve(&output, 128);
+				output.used += write_row(row, slot * stride, &options, &state) - row;
+			}
+		}
+	}
+	if (output_close(&output) != 0) {
 		return 1;
 	}
 
-	printf("\n%d articles generated!\n\n", max);
+	/* Writing the trace, the kind of each command is drawn with the probability of the commands left of that kind */
+	if (options.trace != NULL) {
+		uint64_t left[3] = {inserts, removes, options.ops - inserts - removes};
+		uint64_t inserted = 0, removed = 0;
+
+		if (output_open(&output, options.trace) != 0) {
+			return 1;
+		}
+		for (i = 0; i < options.ops; i++) {
+			uint64_t pick = random_below(&state, left[0] + left[1] + left[2]);
+			char     *out = output_reserve(&output, 160);
+			char     *start = out;
+
+			if (pick < left[0]) {
+				left[0]--;
+				memcpy(out, "insert ", 7);
+				out = write_row(out + 7, unpermute(&slots, options.rows + inserted++) * stride, &options, &state);
+			} else if (pick < left[0] + left[1]) {
+				left[1]--;
+				memcpy(out, "remove ", 7);
+				out = write_id(out + 7, unpermute(&slots, permute(&removals, removed++)) * stride);
+				*out++ = '\n';
+			} else {
+				uint64_t query = random_below(&state, 4);
+				left[2]--;
+				if (query < 2) {
+					memcpy(out, query == 0 ? "find " : "rank ", 5);
+					out = write_id(out + 5, unpermute(&slots, random_below(&state, options.rows)) * stride);
+				} else if (query == 2) {
+					uint32_t low = (uint32_t) random_below(&state, MAX_DURATION);
+					memcpy(out, "range ", 6);
+					out = write_number(out + 6, low);
+					*out++ = ' ';
+					out = write_number(out, low + random_below(&state, 60));
+				} else {
+					memcpy(out, "slowest ", 8);
+					out = write_number(out + 8, 1 + random_below(&state, 10));
+				}
+				*out++ = '\n';
+			}
+			output.used += out - start;
+		}
+		if (output_close(&output) != 0) {
+			return 1;
+		}
+	}
+
+	/* On stderr, since the rows or the trace may be going to stdout */
+	fprintf(stderr, "\n%llu articles generated!\n\n", options.rows);
 
 	return 0;
 }
 
-void clear_buffer()
+/* The function returns the next number of a splitmix64 generator */
+uint64_t next_random(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/* The function returns a random number from 0 to bound - 1, 0 if bound is 0 */
+uint64_t random_below(uint64_t *state, uint64_t bound)
+{
+	return bound == 0 ? 0 : next_random(state) % bound;
+}
+
+/* The function returns a random number between 0 (included) and 1 (excluded) */
+double random_ratio(uint64_t *state)
+{
+	return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+void permutation_init(struct permutation *permutation, uint64_t size, uint64_t *state)
+{
+	int i;
+
+	permutation->size = size;
+	permutation->half_bits = 1;
+	while (permutation->half_bits < 32 && (1ULL << (2 * permutation->half_bits)) < size) {
+		permutation->half_bits++;
+	}
+	for (i = 0; i < 4; i++) {
+		permutation->keys[i] = next_random(state);
+	}
+}
+
+/* The function returns the value the permutation maps the given one to */
+uint64_t permute(struct permutation *permutation, uint64_t value)
+{
+	uint64_t mask = (1ULL << permutation->half_bits) - 1;
+	int      i;
+
+	do {
+		uint64_t left = value >> permutation->half_bits, right = value & mask;
+		for (i = 0; i < 4; i++) {
+			uint64_t key = permutation->keys[i] ^ right;
+			uint64_t next = left ^ (next_random(&key) & mask);
+			left = right;
+			right = next;
+		}
+		value = left << permutation->half_bits | right;
+	} while (value >= permutation->size);
+
+	return value;
+}
+
+/* The function returns the value the permutation maps to the given one */
+uint64_t unpermute(struct permutation *permutation, uint64_t value)
 {
-	char c;
-	while ((c = getchar()) != '\n' && c != EOF);
+	uint64_t mask = (1ULL << permutation->half_bits) - 1;
+	int      i;
+
+	do {
+		uint64_t left = value >> permutation->half_bits, right = value & mask;
+		for (i = 3; i >= 0; i--) {
+			uint64_t key = permutation->keys[i] ^ left;
+			uint64_t previous = right ^ (next_random(&key) & mask);
+			right = left;
+			left = previous;
+		}
+		value = left << permutation->half_bits | right;
+	} while (value >= permutation->size);
+
+	return value;
 }
 
-int get_valid_int(char *field_name)
+/* The function opens a file for writing ("-" is stdout) with its buffer. It returns 0 on success, -1 on failure */
+int output_open(struct output *output, const char *file)
 {
-	int is_valid = 0;
-	int value;
-	char term;
-	while (!is_valid) {
-		if (scanf("%d%c", &value, &term) != 2 || term != '\n') {
-			clear_buffer();
-			printf("%s must be an integer, try again: ", field_name);
+	output->file = strcmp(file, "-") == 0 ? stdout : fopen(file, "w");
+	output->data = (char *) malloc(OUTPUT_BUFFER_SIZE);
+	output->used = 0;
+	if (output->file == NULL || output->data == NULL) {
+		fprintf(stderr, "Error opening file!\n");
+		if (output->file != NULL && output->file != stdout) {
+			fclose(output->file);
+		}
+		free(output->data);
+		output->data = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/* The function returns where the next length bytes can be formatted, writing the buffer first if they don't fit */
+char *output_reserve(struct output *output, size_t length)
+{
+	if (output->used + length > OUTPUT_BUFFER_SIZE) {
+		fwrite(output->data, 1, output->used, output->file);
+		output->used = 0;
+	}
+
+	return output->data + output->used;
+}
+
+/* The function writes what is left in the buffer and closes the file. It returns 0 on success, -1 on failure */
+int output_close(struct output *output)
+{
+	int failed = fwrite(output->data, 1, output->used, output->file) != output->used;
+
+	/* ferror also catches a short write while flushing in output_reserve */
+	failed |= ferror(output->file) != 0;
+	failed |= output->file == stdout ? fflush(stdout) != 0 : fclose(output->file) != 0;
+	free(output->data);
+	if (failed) {
+		fprintf(stderr, "Error writing file!\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* The function writes an id in base 62, most significant character first, so the ids sort like their values */
+char *write_id(char *out, uint64_t value)
+{
+	int i;
+
+	value %= ID_SPACE;
+	for (i = ID_LENGTH - 1; i >= 0; i--) {
+		out[i] = ID_CHARACTERS[value % 62];
+		value /= 62;
+	}
+
+	return out + ID_LENGTH;
+}
+
+/* The function writes a time of the day as hh:mm:ss */
+char *write_time(char *out, uint32_t seconds)
+{
+	uint32_t hours = seconds / 3600, minutes = seconds / 60 % 60;
+
+	seconds %= 60;
+	out[0] = (char) ('0' + hours / 10);
+	out[1] = (char) ('0' + hours % 10);
+	out[2] = ':';
+	out[3] = (char) ('0' + minutes / 10);
+	out[4] = (char) ('0' + minutes % 10);
+	out[5] = ':';
+	out[6] = (char) ('0' + seconds / 10);
+	out[7] = (char) ('0' + seconds % 10);
+
+	return out + 8;
+}
+
+char *write_number(char *out, unsigned long long value)
+{
+	char digits[20];
+	int  count = 0;
+
+	do {
+		digits[count++] = (char) ('0' + value % 10);
+		value /= 10;
+	} while (value > 0);
+	while (count > 0) {
+		*out++ = digits[--count];
+	}
+
+	return out;
+}
+
+/* The function writes the name with the given index: the first ones are the names of the list,
+ * the next ones have a number after them */
+char *write_name(char *out, unsigned long index)
+{
+	size_t length = strlen(names[index % ARRAY_LENGTH]);
+
+	memcpy(out, names[index % ARRAY_LENGTH], length);
+	out += length;
+	if (index >= ARRAY_LENGTH) {
+		*out++ = '_';
+		out = write_number(out, index / ARRAY_LENGTH);
+	}
+
+	return out;
+}
+
+/* The function writes a row of the input file with the given product id and random fields */
+char *write_row(char *out, uint64_t id, const struct options *options, uint64_t *state)
+{
+	uint32_t duration, entry;
+	int      midnight;
+
+	if (random_ratio(state) < options->same_duration) {
+		duration = common_durations[random_below(state, sizeof(common_durations) / sizeof(common_durations[0]))];
+	} else {
+		duration = 1 + (uint32_t) random_below(state, MAX_DURATION);
+	}
+	midnight = random_ratio(state) < options->midnight;
+	if (midnight) {
+		entry = SECONDS_PER_DAY - 1 - (uint32_t) random_below(state, duration);
+	} else {
+		entry = (uint32_t) random_below(state, SECONDS_PER_DAY - duration);
+	}
+
+	out = write_id(out, id);
+	*out++ = ' ';
+	out = write_name(out, (unsigned long) random_below(state, options->names));
+	*out++ = ' ';
+	/* Piece ids are spread over the id space multiplying their index by a number prime with 62 */
+	out = write_id(out, random_below(state, options->pieces) * 1000003);
+	*out++ = ' ';
+	out = write_time(out, entry);
+	*out++ = ' ';
+	out = write_time(out, (entry + duration) % SECONDS_PER_DAY);
+	if (midnight) {
+		memcpy(out, " 1", 2);
+		out += 2;
+	}
+	*out++ = '\n';
+
+	return out;
+}
+
+/* The function reads the command line options. It returns 0 on success, -1 if an option is not valid */
+int parse_options(int argc, char *argv[], struct options *options)
+{
+	int i, ops_given = 0;
+
+	options->rows = ARRAY_LENGTH;
+	options->seed = 1;
+	options->file = INPUT_FILE;
+	options->ids = IDS_DENSE;
+	options->order = ORDER_RANDOM;
+	options->same_duration = 0.1;
+	options->midnight = 0.05;
+	options->names = ARRAY_LENGTH;
+	options->pieces = ARRAY_LENGTH;
+	options->trace = NULL;
+	options->ops = 0;
+	options->mix[0] = 40;
+	options->mix[1] = 30;
+	options->mix[2] = 30;
+
+	for (i = 1; i < argc; i++) {
+		const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+		int        valid = value != NULL;
+
+		if (valid && strcmp(argv[i], "-n") == 0) {
+			options->rows = strtoull(value, NULL, 10);
+		} else if (valid && strcmp(argv[i], "-s") == 0) {
+			options->seed = strtoull(value, NULL, 10);
+		} else if (valid && strcmp(argv[i], "-o") == 0) {
+			options->file = value;
+		} else if (valid && strcmp(argv[i], "--ids") == 0) {
+			options->ids = strcmp(value, "sparse") == 0 ? IDS_SPARSE : IDS_DENSE;
+			valid = options->ids == IDS_SPARSE || strcmp(value, "dense") == 0;
+		} else if (valid && strcmp(argv[i], "--order") == 0) {
+			options->order = strcmp(value, "sorted") == 0 ? ORDER_SORTED : strcmp(value, "reverse") == 0 ? ORDER_REVERSE : ORDER_RANDOM;
+			valid = options->order != ORDER_RANDOM || strcmp(value, "random") == 0;
+		} else if (valid && strcmp(argv[i], "--same-duration") == 0) {
+			options->same_duration = atof(value);
+		} else if (valid && strcmp(argv[i], "--midnight") == 0) {
+			options->midnight = atof(value);
+		} else if (valid && strcmp(argv[i], "--names") == 0) {
+			options->names = strtoul(value, NULL, 10);
+			valid = options->names > 0;
+		} else if (valid && strcmp(argv[i], "--pieces") == 0) {
+			options->pieces = strtoul(value, NULL, 10);
+			valid = options->pieces > 0;
+		} else if (valid && strcmp(argv[i], "--trace") == 0) {
+			options->trace = value;
+		} else if (valid && strcmp(argv[i], "--ops") == 0) {
+			options->ops = strtoull(value, NULL, 10);
+			ops_given = 1;
+		} else if (valid && strcmp(argv[i], "--mix") == 0) {
+			valid = sscanf(value, "%d:%d:%d", &options->mix[0], &options->mix[1], &options->mix[2]) == 3
+			        && options->mix[0] >= 0 && options->mix[1] >= 0 && options->mix[2] >= 0
+			        && options->mix[0] + options->mix[1] + options->mix[2] == 100;
 		} else {
-			if (value < 0 || value > ARRAY_LENGTH) {
-				printf("%s must be between 0 and 50, try again: ", field_name);
-			} else {
-				is_valid = 1;
-			}
+			valid = 0;
 		}
+
+		if (!valid) {
+			fprintf(stderr, "Usage: %s [-n rows] [-s seed] [-o file] [--ids dense|sparse] [--order sorted|reverse|random]\n"
+			                "       [--same-duration ratio] [--midnight ratio] [--names count] [--pieces count]\n"
+			                "       [--trace file] [--ops count] [--mix insert:remove:query]\n", argv[0]);
+			return -1;
+		}
+		i++;
 	}
 
-	return value;
-}
\ No newline at end of file
+	if (!ops_given) {
+		options->ops = options->rows;
+	}
+
+	return 0;
+}